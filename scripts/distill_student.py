@@ -0,0 +1,155 @@
+import argparse
+import os
+from time import strftime
+
+import numpy as np
+
+from params import *
+from export_cnn import write_model_file, DIGIT_STUDENT_TENSORS, MODEL_FLOAT32
+from quantize_cnn import conv3x3, max_pool
+
+dir_path = os.path.dirname(__file__)
+
+# Soft targets: the teacher's probabilities at TEMPERATURE, weighted against the labels by SOFT_WEIGHT
+TEMPERATURE = 4.0
+SOFT_WEIGHT = 0.7
+STUDENT_EPOCHS = 30
+
+
+# The combination network of training_cnn.py, answering N x 10 probabilities
+def keras_teacher(architecture, weights):
+    from keras.models import model_from_json
+
+    with open(architecture, 'r') as f:
+        model = model_from_json(f.read())
+    model.load_weights(weights)
+    return model.predict
+
+
+# The same teacher from its model file (export_cnn.py), in numpy
+def model_file_teacher(path):
+    from export_cnn import read_model_file
+    from quantize_cnn import float_forward
+
+    net = {name: np.array(array, np.float32) for name, array in read_model_file(path).items()}
+
+    def run(x):
+        logits = float_forward(net, x[..., 0])
+        e = np.exp(logits - logits.max(axis=1, keepdims=True))
+        return e / e.sum(axis=1, keepdims=True)
+    return run
+
+
+# softmax(logits / T) from the probabilities softmax(logits): p^(1 / T), normalized
+def soften(probabilities, temperature):
+    p = np.power(np.clip(probabilities, 1e-12, 1.0), 1.0 / temperature)
+    return p / p.sum(axis=1, keepdims=True)
+
+
+# Conv3x3-16, MaxPool2, SeparableConv3x3-32, MaxPool2, SeparableConv3x3-64, Dense10: about 9k
+# parameters and 1 / 60 of the multiplications of the teacher. The output is the logits
+def build_student(input_shape):
+    from keras.models import Sequential
+    from keras.layers import Conv2D, SeparableConv2D, MaxPooling2D, Flatten, Dense
+
+    model = Sequential()
+    model.add(Conv2D(16, (3, 3), activation='relu', input_shape=input_shape))
+    model.add(MaxPooling2D(pool_size=(2, 2)))
+    model.add(SeparableConv2D(32, (3, 3), activation='relu'))
+    model.add(MaxPooling2D(pool_size=(2, 2)))
+    model.add(SeparableConv2D(64, (3, 3), activation='relu'))
+    model.add(Flatten())
+    model.add(Dense(num_classes))
+    return model
+
+
+# y_true holds the one-hot label, then the soft targets of the teacher
+def distillation_loss(y_true, logits):
+    from keras import backend as K
+
+    hard, soft = y_true[:, :num_classes], y_true[:, num_classes:]
+    hard_loss = K.categorical_crossentropy(hard, K.softmax(logits))
+    soft_loss = K.categorical_crossentropy(soft, K.softmax(logits / TEMPERATURE))
+    return (1 - SOFT_WEIGHT) * hard_loss + SOFT_WEIGHT * TEMPERATURE ** 2 * soft_loss
+
+
+def depthwise3x3(x, kernel):
+    windows = np.lib.stride_tricks.sliding_window_view(x, (3, 3), axis=(1, 2))  # N, H-2, W-2, C, 3, 3
+    return np.einsum('nhwcij,ijc->nhwc', windows, kernel[..., 0])
+
+
+def separable(x, net, name):
+    pointwise = net[name + '.pointwise']
+    return np.maximum(depthwise3x3(x, net[name + '.depthwise']) @ pointwise.reshape(pointwise.shape[-2:]) + net[name + '.bias'], 0)
+
+
+# Forward pass of the C++ DigitStudent, to check the export. x: N x 28 x 28 of 0 / 1
+def student_forward(net, x):
+    pool1 = max_pool(np.maximum(conv3x3(x[..., None], net['conv1.kernel']) + net['conv1.bias'], 0))
+    sep1 = separable(pool1, net, 'sep1')
+    pool2 = max_pool(sep1[:, :sep1.shape[1] // 2 * 2, :sep1.shape[2] // 2 * 2])
+    features = separable(pool2, net, 'sep2').reshape(len(x), -1)
+    return features @ net['dense.kernel'] + net['dense.bias']
+
+
+def export_student(model, output):
+    arrays = model.get_weights()
+    shapes = [a.shape for a in arrays]
+    if shapes != [shape for name, shape in DIGIT_STUDENT_TENSORS]:
+        raise ValueError("Unexpected architecture: %s" % shapes)
+
+    write_model_file(output, [(name, shape, np.ascontiguousarray(a, dtype='<f4').tobytes(), MODEL_FLOAT32)
+                              for (name, shape), a in zip(DIGIT_STUDENT_TENSORS, arrays)])
+    print("Wrote", output)
+    return {name: np.array(a, np.float32) for (name, shape), a in zip(DIGIT_STUDENT_TENSORS, arrays)}
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Distill the combination network into the small student of the C++ DigitStudent')
+    parser.add_argument('--architecture', default=dir_path + '/trained_net/combination_architecture_2018-07-03_20.07.33.json')
+    parser.add_argument('--weights', default=dir_path + '/trained_net/combination_weights_2018-07-03_20.07.33.h5')
+    parser.add_argument('--teacher-model', help='float model file of export_cnn.py, run with numpy instead of Keras')
+    parser.add_argument('--output', default=dir_path + '/trained_net/digit_student.model')
+    args = parser.parse_args()
+
+    import keras
+    from keras import backend as K
+    from preparing_dataset import load_our_dataset, save_model
+
+    if K.image_data_format() == 'channels_first':
+        raise ValueError("The student is exported channels_last, like DigitCnn")
+
+    # The data of the teacher, prepared as in training_cnn.py
+    (x_train, y_train), (x_test, y_test) = load_our_dataset(dataset='combination', whiten=0, even_training=False)
+    x_train = x_train.reshape(-1, img_rows, img_cols, 1).astype('float32') / 255
+    x_test = x_test.reshape(-1, img_rows, img_cols, 1).astype('float32') / 255
+
+    teacher = model_file_teacher(args.teacher_model) if args.teacher_model else keras_teacher(args.architecture, args.weights)
+    teacher_test = teacher(x_test)
+    teacher_accuracy = np.mean(teacher_test.argmax(axis=1) == y_test)
+
+    targets = np.concatenate([keras.utils.np_utils.to_categorical(y_train, num_classes),
+                              soften(teacher(x_train), TEMPERATURE)], axis=1)
+    test_targets = np.concatenate([keras.utils.np_utils.to_categorical(y_test, num_classes),
+                                   soften(teacher_test, TEMPERATURE)], axis=1)
+
+    student = build_student((img_rows, img_cols, 1))
+    print(student.summary())
+    student.compile(loss=distillation_loss, optimizer=keras.optimizers.Adam(1e-3))
+    student.fit(x_train, targets,
+                batch_size=batch_size,
+                epochs=STUDENT_EPOCHS,
+                verbose=1,
+                validation_data=(x_test, test_targets))
+
+    student_accuracy = np.mean(student.predict(x_test).argmax(axis=1) == y_test)
+    save_model(student, title_dataset='student', time=strftime("%Y-%m-%d_%H.%M.%S"))
+
+    # The exported weights must give what Keras gives
+    net = export_student(student, args.output)
+    exported = student_forward(net, x_test[:512, ..., 0])
+    print("Largest difference to Keras: %g" % np.abs(exported - student.predict(x_test[:512])).max())
+
+    print("Teacher: %.2f %%, student: %.2f %% of %d test digits, %d parameters"
+          % (100 * teacher_accuracy, 100 * student_accuracy, len(y_test), student.count_params()))
+    print("Latency: ./benchmark_classifiers scripts/cnn_train_digits student=%s" % args.output)
@@ -0,0 +1,122 @@
+import argparse
+import glob
+import os
+import struct
+
+dir_path = os.path.dirname(__file__)
+
+# Must match src/ModelFile.h
+MODEL_FILE_MAGIC = b'SUDOKUNN'
+MODEL_FILE_VERSION = 1
+MODEL_FILE_ALIGN = 64
+MODEL_TENSOR_NAME_SIZE = 24
+MODEL_TENSOR_MAX_RANK = 4
+MODEL_FLOAT32 = 0
+MODEL_INT8 = 1
+
+HEADER_FORMAT = '<8sIIQ40x'  # magic, version, tensorCount, fileSize
+ENTRY_FORMAT = '<%dsII%dIQQ' % (MODEL_TENSOR_NAME_SIZE, MODEL_TENSOR_MAX_RANK)  # name, type, rank, shape, offset, bytes
+
+# Names and shapes DigitCnn (src/DigitCnn.h) expects, in the order of model.get_weights()
+DIGIT_CNN_TENSORS = [('conv1.kernel', (3, 3, 1, 32)), ('conv1.bias', (32,)),
+                     ('conv2.kernel', (3, 3, 32, 64)), ('conv2.bias', (64,)),
+                     ('dense1.kernel', (9216, 128)), ('dense1.bias', (128,)),
+                     ('dense2.kernel', (128, 10)), ('dense2.bias', (10,))]
+
+# Same for the distilled DigitStudent (src/DigitStudent.h), see distill_student.py
+DIGIT_STUDENT_TENSORS = [('conv1.kernel', (3, 3, 1, 16)), ('conv1.bias', (16,)),
+                         ('sep1.depthwise', (3, 3, 16, 1)), ('sep1.pointwise', (1, 1, 16, 32)), ('sep1.bias', (32,)),
+                         ('sep2.depthwise', (3, 3, 32, 1)), ('sep2.pointwise', (1, 1, 32, 64)), ('sep2.bias', (64,)),
+                         ('dense.kernel', (576, 10)), ('dense.bias', (10,))]
+
+
+def align(offset):
+    return (offset + MODEL_FILE_ALIGN - 1) // MODEL_FILE_ALIGN * MODEL_FILE_ALIGN
+
+
+# Reads a model file into a dict of name: numpy array
+def read_model_file(path):
+    import numpy as np
+
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, tensor_count, file_size = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != MODEL_FILE_MAGIC or version != MODEL_FILE_VERSION or file_size != len(data):
+        raise ValueError("%s is not a model file of version %d" % (path, MODEL_FILE_VERSION))
+
+    tensors = {}
+    for i in range(tensor_count):
+        entry = struct.unpack_from(ENTRY_FORMAT, data, struct.calcsize(HEADER_FORMAT) + i * struct.calcsize(ENTRY_FORMAT))
+        name = entry[0].split(b'\0')[0].decode('ascii')
+        data_type, rank = entry[1], entry[2]
+        shape = entry[3:3 + rank]
+        offset, size = entry[3 + MODEL_TENSOR_MAX_RANK], entry[4 + MODEL_TENSOR_MAX_RANK]
+        dtype = '<f4' if data_type == MODEL_FLOAT32 else 'i1'
+        tensors[name] = np.frombuffer(data, dtype=dtype, count=size // np.dtype(dtype).itemsize, offset=offset).reshape(shape)
+    return tensors
+
+
+# Writes (name, shape, little-endian bytes, MODEL_FLOAT32 or MODEL_INT8) tensors as a model file
+def write_model_file(output, tensors):
+    offset = align(struct.calcsize(HEADER_FORMAT) + len(tensors) * struct.calcsize(ENTRY_FORMAT))
+    entries = []
+    for name, shape, data, data_type in tensors:
+        entries.append(struct.pack(ENTRY_FORMAT, name.encode('ascii'), data_type, len(shape),
+                                   *(list(shape) + [1] * (MODEL_TENSOR_MAX_RANK - len(shape))),
+                                   offset, len(data)))
+        offset = align(offset + len(data))
+
+    with open(output, 'wb') as f:
+        f.write(struct.pack(HEADER_FORMAT, MODEL_FILE_MAGIC, MODEL_FILE_VERSION, len(tensors), offset))
+        f.write(b''.join(entries))
+        for name, shape, data, data_type in tensors:
+            f.write(b'\0' * (align(f.tell()) - f.tell()))
+            f.write(data)
+        f.write(b'\0' * (offset - f.tell()))
+
+
+# Converts a Keras network (architecture json + h5 weights) for the C++ DigitCnn
+def export_network(architecture, weights, output):
+    from keras.models import model_from_json
+    import numpy as np
+
+    with open(architecture, 'r') as f:
+        model = model_from_json(f.read())
+    model.load_weights(weights)
+
+    arrays = model.get_weights()
+    shapes = [a.shape for a in arrays]
+    if shapes != [shape for name, shape in DIGIT_CNN_TENSORS]:
+        raise ValueError("Unexpected architecture: %s" % shapes)
+
+    tensors = [(name, shape, np.ascontiguousarray(a, dtype='<f4').tobytes(), MODEL_FLOAT32)
+               for (name, shape), a in zip(DIGIT_CNN_TENSORS, arrays)]
+    write_model_file(output, tensors)
+
+    print("Wrote", output)
+
+
+# Every <dataset>_architecture_<time>.json of trained_net that has its weights next to it
+def export_all(net_dir):
+    for architecture in sorted(glob.glob(net_dir + '/*_architecture_*.json')):
+        weights = architecture.replace('_architecture_', '_weights_')[:-len('.json')] + '.h5'
+        if not os.path.exists(weights):
+            print("No weights for", architecture)
+            continue
+        output = architecture.replace('_architecture_', '_')[:-len('.json')] + '.model'
+        export_network(architecture, weights, output)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Convert trained digit networks into model files for the C++ DigitCnn')
+    parser.add_argument('--all', action='store_true', help='convert every network in trained_net')
+    parser.add_argument('--architecture', default=dir_path + '/trained_net/combination_architecture_2018-07-03_20.07.33.json')
+    parser.add_argument('--weights', default=dir_path + '/trained_net/combination_weights_2018-07-03_20.07.33.h5')
+    parser.add_argument('--output', default=dir_path + '/trained_net/digit_cnn.model')
+    args = parser.parse_args()
+
+    if args.all:
+        export_all(dir_path + '/trained_net')
+    else:
+        export_network(args.architecture, args.weights, args.output)
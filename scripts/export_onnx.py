@@ -0,0 +1,65 @@
+import argparse
+import os
+
+import numpy as np
+
+from export_cnn import read_model_file
+
+dir_path = os.path.dirname(__file__)
+
+OPSET = 11
+
+
+# Builds the ONNX graph of the digit network from a float model file, for the C++ DnnClassifier (cv::dnn).
+# Input 'cells': N x 1 x 28 x 28, the binary tiles (ink is 1). Output 'digits': N x 10 softmax probabilities
+def export_onnx(net, output):
+    import onnx
+    from onnx import helper, numpy_helper, TensorProto
+
+    def initializer(name, array):
+        return numpy_helper.from_array(np.ascontiguousarray(array, dtype=np.float32), name)
+
+    # Keras HWIO kernels to ONNX OIHW
+    initializers = [
+        initializer('conv1.kernel', net['conv1.kernel'].transpose(3, 2, 0, 1)), initializer('conv1.bias', net['conv1.bias']),
+        initializer('conv2.kernel', net['conv2.kernel'].transpose(3, 2, 0, 1)), initializer('conv2.bias', net['conv2.bias']),
+        initializer('dense1.kernel', net['dense1.kernel']), initializer('dense1.bias', net['dense1.bias']),
+        initializer('dense2.kernel', net['dense2.kernel']), initializer('dense2.bias', net['dense2.bias']),
+    ]
+
+    nodes = [
+        helper.make_node('Conv', ['cells', 'conv1.kernel', 'conv1.bias'], ['conv1'], kernel_shape=[3, 3]),
+        helper.make_node('Relu', ['conv1'], ['conv1.relu']),
+        helper.make_node('Conv', ['conv1.relu', 'conv2.kernel', 'conv2.bias'], ['conv2'], kernel_shape=[3, 3]),
+        helper.make_node('Relu', ['conv2'], ['conv2.relu']),
+        helper.make_node('MaxPool', ['conv2.relu'], ['pool'], kernel_shape=[2, 2], strides=[2, 2]),
+        # Keras flattens the pooled features channels last
+        helper.make_node('Transpose', ['pool'], ['pool.hwc'], perm=[0, 2, 3, 1]),
+        helper.make_node('Flatten', ['pool.hwc'], ['features'], axis=1),
+        helper.make_node('Gemm', ['features', 'dense1.kernel', 'dense1.bias'], ['dense1']),
+        helper.make_node('Relu', ['dense1'], ['dense1.relu']),
+        helper.make_node('Gemm', ['dense1.relu', 'dense2.kernel', 'dense2.bias'], ['dense2']),
+        helper.make_node('Softmax', ['dense2'], ['digits'], axis=1),
+    ]
+
+    graph = helper.make_graph(nodes, 'digit_cnn',
+                              [helper.make_tensor_value_info('cells', TensorProto.FLOAT, ['N', 1, 28, 28])],
+                              [helper.make_tensor_value_info('digits', TensorProto.FLOAT, ['N', 10])],
+                              initializers)
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid('', OPSET)])
+    onnx.checker.check_model(model)
+    onnx.save(model, output)
+
+    print("Wrote", output)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Convert a digit network model file into ONNX for the C++ DnnClassifier')
+    parser.add_argument('--input', default=dir_path + '/trained_net/digit_cnn.model')
+    parser.add_argument('--output', default=dir_path + '/trained_net/digit_cnn.onnx')
+    args = parser.parse_args()
+
+    net = {name: np.array(array, np.float32) for name, array in read_model_file(args.input).items()}
+    if 'conv2.kernel' not in net:
+        raise ValueError("%s is not a float model file" % args.input)
+    export_onnx(net, args.output)
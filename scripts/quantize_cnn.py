@@ -0,0 +1,162 @@
+import argparse
+import glob
+import os
+import random
+
+import cv2
+import numpy as np
+
+from params import *
+from export_cnn import read_model_file, write_model_file, MODEL_FLOAT32, MODEL_INT8
+
+dir_path = os.path.dirname(__file__)
+
+# Must match src/DigitCnn.cpp
+GROUP = 4
+MAX_ACTIVATION = 127  # 7-bit activations: maddubs adds two products of at most 127 * 127 without saturating
+MAX_WEIGHT = 127
+
+# Share of the calibration activations that must fit below the top step
+ACTIVATION_PERCENTILE = 99.99
+
+
+# Same preparation as use_cnn.py: 28 x 28, THRESH_BINARY_INV at THRESHOLD_VAL, / 255
+def prepare(image):
+    image = cv2.resize(image, (digit_w, digit_h))
+    return (image <= THRESHOLD_VAL).astype(np.float32)
+
+
+# Labeled training digits (a sample of every class) and the unlabeled cells extracted from real grids
+def load_calibration(per_class):
+    images, labels = [], []
+    for digit in range(num_classes):
+        files = sorted(glob.glob(dir_path + '/cnn_train_digits/%d/*.png' % digit))
+        random.Random(digit).shuffle(files)
+        for path in files[:per_class]:
+            images.append(prepare(cv2.imread(path, GRAYSCALE)))
+            labels.append(digit)
+
+    extracted = []
+    for path in sorted(glob.glob(dir_path + '/extracted_numbers/**/*.png', recursive=True)):
+        extracted.append(prepare(cv2.imread(path, GRAYSCALE)))
+
+    return np.array(images), np.array(labels), np.array(extracted)
+
+
+# 3 x 3 valid convolution of N x H x W x C activations with an HWIO kernel, as one matrix product
+def conv3x3(x, kernel):
+    windows = np.lib.stride_tricks.sliding_window_view(x, (3, 3), axis=(1, 2))  # N, H-2, W-2, C, 3, 3
+    windows = windows.transpose(0, 1, 2, 4, 5, 3)  # N, H-2, W-2, 3, 3, C: same order as the kernel
+    n, h, w = windows.shape[:3]
+    return windows.reshape(n, h, w, -1) @ kernel.reshape(-1, kernel.shape[-1])
+
+
+def max_pool(x):
+    n, h, w, c = x.shape
+    return x.reshape(n, h // 2, 2, w // 2, 2, c).max(axis=(2, 4))
+
+
+def to_activation(x):
+    return np.floor(np.minimum(np.maximum(x, 0), MAX_ACTIVATION) + 0.5)
+
+
+def float_forward(net, x, keep=None):
+    conv1 = np.maximum(conv3x3(x[..., None], net['conv1.kernel']) + net['conv1.bias'], 0)
+    conv2 = np.maximum(conv3x3(conv1, net['conv2.kernel']) + net['conv2.bias'], 0)
+    features = max_pool(conv2).reshape(len(x), -1)
+    hidden = np.maximum(features @ net['dense1.kernel'] + net['dense1.bias'], 0)
+    if keep is not None:
+        keep.append((conv1, conv2))
+    return hidden @ net['dense2.kernel'] + net['dense2.bias']
+
+
+# Per output channel: the largest weight maps to MAX_WEIGHT
+def quantize_weights(kernel):
+    flat = kernel.reshape(-1, kernel.shape[-1])
+    scales = np.maximum(np.abs(flat).max(axis=0), 1e-12) / MAX_WEIGHT
+    return np.clip(np.round(flat / scales), -MAX_WEIGHT, MAX_WEIGHT).astype(np.int8), scales.astype(np.float32)
+
+
+# K x O int8 weights to the layout of DigitCnnQuantizedWeights: K / 4 groups x O x 4
+def pack(weights):
+    k, o = weights.shape
+    return np.ascontiguousarray(weights.reshape(k // GROUP, GROUP, o).transpose(0, 2, 1))
+
+
+def quantize(net, calibration):
+    keep = []
+    for start in range(0, len(calibration), 256):
+        float_forward(net, calibration[start:start + 256], keep)
+    conv1_scale = np.percentile(np.concatenate([c1.ravel() for c1, c2 in keep]), ACTIVATION_PERCENTILE) / MAX_ACTIVATION
+    conv2_scale = np.percentile(np.concatenate([c2.ravel() for c1, c2 in keep]), ACTIVATION_PERCENTILE) / MAX_ACTIVATION
+
+    conv2_q, conv2_w_scales = quantize_weights(net['conv2.kernel'])
+    dense1_q, dense1_w_scales = quantize_weights(net['dense1.kernel'])
+
+    return {
+        'conv1.kernel': net['conv1.kernel'], 'conv1.bias': net['conv1.bias'],
+        'conv1.scale': np.array([conv1_scale], np.float32),
+        'conv2.qkernel': pack(conv2_q),
+        'conv2.multiplier': (conv1_scale * conv2_w_scales / conv2_scale).astype(np.float32),
+        'conv2.offset': (net['conv2.bias'] / conv2_scale).astype(np.float32),
+        'dense1.qkernel': pack(dense1_q),
+        'dense1.multiplier': (conv2_scale * dense1_w_scales).astype(np.float32),
+        'dense1.bias': net['dense1.bias'],
+        'dense2.kernel': net['dense2.kernel'], 'dense2.bias': net['dense2.bias'],
+    }
+
+
+# What DigitCnn computes on a quantized network, to measure the loss of accuracy
+def quantized_forward(q, x):
+    conv1 = conv3x3(x[..., None], q['conv1.kernel']) + q['conv1.bias']
+    conv1 = to_activation(conv1 * (1 / q['conv1.scale'][0]))
+
+    conv2_w = q['conv2.qkernel'].transpose(0, 2, 1).reshape(-1, 64).astype(np.float32)
+    conv2 = to_activation(conv3x3(conv1, conv2_w.reshape(3, 3, 32, 64)) * q['conv2.multiplier'] + q['conv2.offset'])
+    features = max_pool(conv2).reshape(len(x), -1)
+
+    dense1_w = q['dense1.qkernel'].transpose(0, 2, 1).reshape(-1, 128).astype(np.float32)
+    hidden = np.maximum(features @ dense1_w * q['dense1.multiplier'] + q['dense1.bias'], 0)
+    return hidden @ q['dense2.kernel'] + q['dense2.bias']
+
+
+def predict(forward, net, x):
+    return np.concatenate([forward(net, x[start:start + 256]).argmax(axis=1) for start in range(0, len(x), 256)])
+
+
+def report(net, q, images, labels, extracted):
+    float_labels = predict(float_forward, net, images)
+    int8_labels = predict(quantized_forward, q, images)
+    float_accuracy = (float_labels == labels).mean()
+    int8_accuracy = (int8_labels == labels).mean()
+    print("Training digits (%d): fp32 %.2f %%, int8 %.2f %%, delta %+.2f %%, same answer %.2f %%"
+          % (len(labels), 100 * float_accuracy, 100 * int8_accuracy, 100 * (int8_accuracy - float_accuracy),
+             100 * (float_labels == int8_labels).mean()))
+
+    if len(extracted):
+        same = (predict(float_forward, net, extracted) == predict(quantized_forward, q, extracted)).mean()
+        print("Extracted cells (%d): same answer as fp32 %.2f %%" % (len(extracted), 100 * same))
+
+
+def save(q, output):
+    tensors = []
+    for name, array in q.items():
+        data_type = MODEL_INT8 if array.dtype == np.int8 else MODEL_FLOAT32
+        tensors.append((name, array.shape, np.ascontiguousarray(array, dtype='i1' if data_type == MODEL_INT8 else '<f4').tobytes(), data_type))
+    write_model_file(output, tensors)
+    print("Wrote", output)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Quantize a digit network model file to int8 for the C++ DigitCnn')
+    parser.add_argument('--input', default=dir_path + '/trained_net/digit_cnn.model')
+    parser.add_argument('--output', default=dir_path + '/trained_net/digit_cnn_int8.model')
+    parser.add_argument('--per-class', type=int, default=200, help='training digits of every class used to calibrate')
+    args = parser.parse_args()
+
+    net = {name: np.array(array, np.float32) for name, array in read_model_file(args.input).items()}
+    images, labels, extracted = load_calibration(args.per_class)
+
+    q = quantize(net, np.concatenate([images, extracted]))
+    report(net, q, images, labels, extracted)
+    save(q, args.output)
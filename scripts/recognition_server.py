@@ -0,0 +1,203 @@
+import argparse
+import mmap
+import os
+import selectors
+import socket
+import struct
+import time
+
+import numpy as np
+
+from params import *
+
+dir_path = os.path.dirname(__file__)
+
+# Must match src/RemoteClassifier.h
+SOCKET_PATH = '/tmp/sudoku_ar_recognizer.sock'
+MAGIC = b'SUDOKUSH'
+VERSION = 1
+MAX_TILES = 81
+SEGMENT_HEADER_FORMAT = '<8sIIQ40x'  # magic, version, slots, slotBytes
+SLOT_HEADER_FORMAT = '<IIQ48x'  # count, reserved, sequence
+MESSAGE_FORMAT = '<IIIIQ40s'  # type, slot, count, reserved, sequence, name
+HELLO, REQUEST, RESULT, ERROR = 1, 2, 3, 4
+
+ALIGN = 64
+SEGMENT_HEADER_BYTES = struct.calcsize(SEGMENT_HEADER_FORMAT)
+TILES_OFFSET = struct.calcsize(SLOT_HEADER_FORMAT)
+TILES_BYTES = (MAX_TILES * digit_w * digit_h + ALIGN - 1) // ALIGN * ALIGN
+PROBABILITIES_OFFSET = TILES_OFFSET + TILES_BYTES
+MESSAGE_BYTES = struct.calcsize(MESSAGE_FORMAT)
+
+# After the first request of a batch, how long to wait for the other cameras
+BATCH_WINDOW = 0.002
+
+
+# The Keras network, loaded once. Answers N x 10 softmax probabilities for N binary tiles
+def keras_network(architecture, weights):
+    from keras.models import model_from_json
+    from keras import backend as k
+
+    with open(architecture, 'r') as f:
+        model = model_from_json(f.read())
+    model.load_weights(weights)
+    channels_first = k.image_data_format() == 'channels_first'
+
+    def run(x):
+        x = x[:, None] if channels_first else x[..., None]
+        return model.predict(x)
+    return run
+
+
+# The same network from a float model file of export_cnn.py, in numpy, where Keras is not installed
+def model_file_network(path):
+    from export_cnn import read_model_file
+    from quantize_cnn import float_forward
+
+    net = {name: np.array(array, np.float32) for name, array in read_model_file(path).items()}
+
+    def run(x):
+        logits = float_forward(net, x)
+        e = np.exp(logits - logits.max(axis=1, keepdims=True))
+        return e / e.sum(axis=1, keepdims=True)
+    return run
+
+
+class Client:
+    def __init__(self, connection):
+        self.connection = connection
+        self.buffer = b''
+        self.segment = None
+        self.slot_bytes = 0
+
+    def attach(self, name):
+        # The client unlinks the name as soon as it is answered: map it now
+        fd = os.open('/dev/shm/' + name.lstrip('/'), os.O_RDWR)
+        try:
+            self.segment = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+        magic, version, slots, self.slot_bytes = struct.unpack_from(SEGMENT_HEADER_FORMAT, self.segment)
+        if magic != MAGIC or version != VERSION or self.slot_bytes < PROBABILITIES_OFFSET + MAX_TILES * num_classes * 4:
+            raise ValueError("not a segment of version %d" % VERSION)
+        self.slots = slots
+
+    def slot(self, index):
+        return SEGMENT_HEADER_BYTES + index * self.slot_bytes
+
+    def send(self, message_type, slot=0, count=0, sequence=0):
+        self.connection.sendall(struct.pack(MESSAGE_FORMAT, message_type, slot, count, 0, sequence, b''))
+
+
+class Server:
+    def __init__(self, network, path):
+        self.network = network
+        self.path = path
+        self.selector = selectors.DefaultSelector()
+        self.pending = []  # (client, slot, count, sequence) of the requests of the next batch
+
+    def serve(self):
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+        listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        listener.bind(self.path)
+        listener.listen()
+        self.selector.register(listener, selectors.EVENT_READ, None)
+        print("Listening on", self.path)
+
+        try:
+            while True:
+                self.poll(None)
+                # A little longer for the requests of the other clients, then everything as one batch
+                deadline = time.monotonic() + BATCH_WINDOW
+                while self.pending and time.monotonic() < deadline:
+                    self.poll(max(0.0, deadline - time.monotonic()))
+                self.run_batch()
+        finally:
+            listener.close()
+            os.unlink(self.path)
+
+    def poll(self, timeout):
+        for key, events in self.selector.select(timeout):
+            if key.data is None:
+                connection, _ = key.fileobj.accept()
+                self.selector.register(connection, selectors.EVENT_READ, Client(connection))
+            else:
+                self.read(key.data)
+
+    def drop(self, client):
+        self.selector.unregister(client.connection)
+        client.connection.close()
+        self.pending = [request for request in self.pending if request[0] is not client]
+        if client.segment is not None:
+            client.segment.close()
+
+    def read(self, client):
+        data = client.connection.recv(MESSAGE_BYTES * 16)
+        if not data:
+            self.drop(client)
+            return
+        client.buffer += data
+        while len(client.buffer) >= MESSAGE_BYTES:
+            message = struct.unpack_from(MESSAGE_FORMAT, client.buffer)
+            client.buffer = client.buffer[MESSAGE_BYTES:]
+            message_type, slot, count, _, sequence, name = message
+
+            if message_type == HELLO:
+                try:
+                    client.attach(name.split(b'\0')[0].decode('ascii'))
+                    client.send(HELLO)
+                except (OSError, ValueError) as e:
+                    print("Refused a client:", e)
+                    client.send(ERROR)
+                    self.drop(client)
+                    return
+            elif message_type == REQUEST:
+                if client.segment is None or slot >= client.slots or count > MAX_TILES:
+                    client.send(ERROR, slot, count, sequence)
+                else:
+                    self.pending.append((client, slot, count, sequence))
+
+    def run_batch(self):
+        if not self.pending:
+            return
+        requests, self.pending = self.pending, []
+
+        # The tiles of every request, straight from the segments, as one batch
+        tiles = []
+        for client, slot, count, sequence in requests:
+            offset = client.slot(slot) + TILES_OFFSET
+            tiles.append(np.frombuffer(client.segment, np.uint8, count * digit_w * digit_h, offset))
+        x = (np.concatenate(tiles).reshape(-1, digit_h, digit_w) <= THRESHOLD_VAL).astype(np.float32)
+        # x is a copy: no view may export a segment any more, or closing it raises BufferError
+        del tiles
+        probabilities = self.network(x).astype('<f4') if len(x) else np.zeros((0, num_classes), '<f4')
+
+        # A client that went away is only dropped once every request is answered, its other requests are skipped
+        failed = []
+        first = 0
+        for client, slot, count, sequence in requests:
+            first += count
+            if client in failed:
+                continue
+            offset = client.slot(slot) + PROBABILITIES_OFFSET
+            client.segment[offset:offset + count * num_classes * 4] = probabilities[first - count:first].tobytes()
+            try:
+                client.send(RESULT, slot, count, sequence)
+            except OSError:
+                failed.append(client)
+
+        for client in failed:
+            self.drop(client)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Keep the digit network loaded and classify the cells of the C++ RemoteClassifier')
+    parser.add_argument('--socket', default=SOCKET_PATH)
+    parser.add_argument('--architecture', default=dir_path + '/trained_net/combination_architecture_2018-07-03_20.07.33.json')
+    parser.add_argument('--weights', default=dir_path + '/trained_net/combination_weights_2018-07-03_20.07.33.h5')
+    parser.add_argument('--model', help='float model file of export_cnn.py, run with numpy instead of Keras')
+    args = parser.parse_args()
+
+    network = model_file_network(args.model) if args.model else keras_network(args.architecture, args.weights)
+    Server(network, args.socket).serve()
@@ -0,0 +1,86 @@
+import argparse
+import glob
+import os
+import random
+
+import cv2
+import numpy as np
+
+from params import *
+from export_cnn import write_model_file, MODEL_FLOAT32
+
+dir_path = os.path.dirname(__file__)
+
+# Must match src/HogClassifier.cpp: 3 x 3 blocks of 2 x 2 cells of 7 pixels, 9 orientations
+HOG = cv2.HOGDescriptor((digit_w, digit_h), (14, 14), (7, 7), (7, 7), 9)
+
+# One-vs-rest linear SVMs, squared hinge loss, trained by gradient descent
+REGULARIZATION = 1e-4
+LEARNING_RATE = 0.5
+EPOCHS = 300
+VALIDATION_SHARE = 0.2
+
+
+# Same binary tile as HogClassifier: THRESH_BINARY_INV at THRESHOLD_VAL
+def features(image):
+    image = cv2.resize(image, (digit_w, digit_h))
+    _, binary = cv2.threshold(image, THRESHOLD_VAL, 255, cv2.THRESH_BINARY_INV)
+    return HOG.compute(binary).ravel()
+
+
+def load_digits():
+    x, y, paths = [], [], []
+    for digit in range(num_classes):
+        for path in sorted(glob.glob(dir_path + '/cnn_train_digits/%d/*.png' % digit)):
+            x.append(features(cv2.imread(path, GRAYSCALE)))
+            y.append(digit)
+            paths.append(path)
+    return np.array(x, np.float32), np.array(y), paths
+
+
+# One "<path relative to the list> <digit>" line per held-out digit, read by src/benchmark_classifiers.cpp
+def write_validation_list(list_path, paths, y, validation):
+    with open(list_path, 'w') as f:
+        for i in validation:
+            f.write('%s %d\n' % (os.path.relpath(paths[i], os.path.dirname(os.path.abspath(list_path))), y[i]))
+
+
+def train(x, y):
+    targets = np.where(np.arange(num_classes)[None, :] == y[:, None], 1.0, -1.0)
+    weights = np.zeros((x.shape[1], num_classes), np.float64)
+    bias = np.zeros(num_classes, np.float64)
+    for epoch in range(EPOCHS):
+        margins = np.maximum(0, 1 - targets * (x @ weights + bias))
+        gradient = -2 * targets * margins / len(x)
+        weights -= LEARNING_RATE * (x.T @ gradient + 2 * REGULARIZATION * weights)
+        bias -= LEARNING_RATE * gradient.sum(axis=0)
+    return weights.astype(np.float32), bias.astype(np.float32)
+
+
+def accuracy(weights, bias, x, y):
+    return ((x @ weights + bias).argmax(axis=1) == y).mean()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Train the HOG + linear SVM digit model of the C++ HogClassifier')
+    parser.add_argument('--output', default=dir_path + '/trained_net/digit_hog.model')
+    parser.add_argument('--validation', default=dir_path + '/trained_net/digit_validation.txt',
+                        help='list of the held-out digits, for benchmark_classifiers')
+    args = parser.parse_args()
+
+    x, y, paths = load_digits()
+    order = list(range(len(y)))
+    random.Random(0).shuffle(order)
+    split = int(len(order) * VALIDATION_SHARE)
+    validation, training = np.array(order[:split]), np.array(order[split:])
+
+    weights, bias = train(x[training], y[training])
+    print("HOG + SVM on %d features: training %.2f %%, validation %.2f %% (%d digits)"
+          % (x.shape[1], 100 * accuracy(weights, bias, x[training], y[training]),
+             100 * accuracy(weights, bias, x[validation], y[validation]), len(validation)))
+
+    # The shipped model never sees the validation digits, so the benchmark can measure it on them
+    write_model_file(args.output, [('hog.weights', weights.shape, weights.astype('<f4').tobytes(), MODEL_FLOAT32),
+                                   ('hog.bias', bias.shape, bias.astype('<f4').tobytes(), MODEL_FLOAT32)])
+    write_validation_list(args.validation, paths, y, validation)
+    print("Wrote", args.output, "and", args.validation)
@@ -0,0 +1,203 @@
+/**
+	BatchScheduler.cpp
+	Purpose:	* Implements the batching of the cells of several streams in front
+				of one digit classifier.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "BatchScheduler.h"
+#include "CellExtractor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsedMs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+}
+
+// The DigitClassifier of one stream: its predict calls go through the scheduler
+class BatchScheduler::Client : public DigitClassifier
+{
+public:
+	Client(BatchScheduler& scheduler) :
+		m_scheduler(scheduler)
+	{
+		m_scheduler.addClient(1);
+	}
+
+	~Client() override
+	{
+		m_scheduler.addClient(-1);
+	}
+
+	// The model is the one of the scheduler
+	bool load(const std::string& path) override
+	{
+		return m_scheduler.isLoaded();
+	}
+
+	bool isLoaded() const override
+	{
+		return m_scheduler.isLoaded();
+	}
+
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override
+	{
+		m_scheduler.predict(tiles, skip, count, digits, confidences);
+	}
+
+private:
+	BatchScheduler& m_scheduler;
+};
+
+BatchScheduler::BatchScheduler(std::unique_ptr<DigitClassifier> classifier, double windowMs, int maxTiles) :
+	m_classifier(std::move(classifier))
+	, m_windowMs(windowMs)
+	, m_maxTiles(maxTiles)
+	, m_pendingTiles(0)
+	, m_clients(0)
+	, m_hasLeader(false)
+{
+	m_stats = BatchStats();
+}
+
+std::unique_ptr<DigitClassifier> BatchScheduler::createClient()
+{
+	return std::unique_ptr<DigitClassifier>(new Client(*this));
+}
+
+bool BatchScheduler::isLoaded() const
+{
+	return m_classifier && m_classifier->isLoaded();
+}
+
+BatchStats BatchScheduler::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void BatchScheduler::addClient(int change)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_clients += change;
+
+	// A leader waiting for the stream that left stops waiting
+	m_changed.notify_all();
+}
+
+void BatchScheduler::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	Request request = { tiles, skip, count, digits, confidences, false };
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_pending.push_back(&request);
+	for (int t = 0; t < count; t++)
+	{
+		if (!skip || !skip[t])
+			m_pendingTiles++;
+	}
+	m_stats.requests++;
+	m_changed.notify_all();
+
+	// Answered by a leader, or lead the next batch once the running one is done
+	while (!request.isDone)
+	{
+		if (!m_hasLeader)
+			runBatch(lock);
+		else
+			m_changed.wait(lock);
+	}
+}
+
+/**
+* Called with the lock held and m_pending not empty. Gathers the tiles of the pending
+* requests into one contiguous batch, classifies it without the lock and scatters the digits.
+* If the classifier throws, every request of the batch is answered with -1, so no stream
+* waits forever, and the exception goes on to the stream that led the batch
+*/
+void BatchScheduler::runBatch(std::unique_lock<std::mutex>& lock)
+{
+	m_hasLeader = true;
+
+	// Wait for the streams that have not submitted yet, but no longer than the window
+	Clock::time_point start = Clock::now();
+	Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(m_windowMs));
+	m_changed.wait_until(lock, deadline, [this] {
+		return (int)m_pending.size() >= m_clients || m_pendingTiles >= m_maxTiles;
+	});
+	m_stats.waitMs += elapsedMs(start);
+
+	std::vector<Request*> requests;
+	requests.swap(m_pending);
+	int numTiles = m_pendingTiles;
+	m_pendingTiles = 0;
+	lock.unlock();
+
+	std::exception_ptr error;
+	Clock::time_point inferenceStart = Clock::now();
+	try
+	{
+		// The tiles to classify, one after the other
+		m_batch.resize((size_t)std::max(1, numTiles) * CELL_PIXELS);
+		m_digits.resize(std::max(1, numTiles));
+		m_confidences.resize(std::max(1, numTiles));
+		int first = 0;
+		for (size_t r = 0; r < requests.size(); r++)
+		{
+			const Request& request = *requests[r];
+			for (int t = 0; t < request.count; t++)
+			{
+				if (!request.skip || !request.skip[t])
+					memcpy(&m_batch[(size_t)first++ * CELL_PIXELS], request.tiles + (size_t)t * CELL_PIXELS, CELL_PIXELS);
+			}
+		}
+
+		inferenceStart = Clock::now();
+		if (numTiles > 0)
+			m_classifier->predict(&m_batch[0], NULL, numTiles, &m_digits[0], &m_confidences[0]);
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+	double inferenceMs = elapsedMs(inferenceStart);
+
+	// Back to every stream, -1 for the skipped tiles and for all of them if the batch failed
+	int first = 0;
+	for (size_t r = 0; r < requests.size(); r++)
+	{
+		Request& request = *requests[r];
+		for (int t = 0; t < request.count; t++)
+		{
+			bool isAnswered = !error && (!request.skip || !request.skip[t]);
+			request.digits[t] = isAnswered ? m_digits[first] : -1;
+			if (request.confidences)
+				request.confidences[t] = isAnswered ? m_confidences[first] : 0.0f;
+			if (isAnswered)
+				first++;
+		}
+	}
+
+	lock.lock();
+	for (size_t r = 0; r < requests.size(); r++)
+		requests[r]->isDone = true;
+	m_hasLeader = false;
+	m_stats.batches++;
+	m_stats.tiles += numTiles;
+	m_stats.inferenceMs += inferenceMs;
+	m_changed.notify_all();
+
+	if (error)
+		std::rethrow_exception(error);
+}
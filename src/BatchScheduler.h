@@ -0,0 +1,98 @@
+/**
+	BatchScheduler.h
+	Purpose:	* Puts one DigitClassifier in front of several streams (cameras or
+				image requests) of the same process: the cells the streams send
+				within a short window are classified as one batch, and the digits
+				are handed back to every stream.
+				* The first stream to submit leads the batch. It waits for the other
+				registered streams for at most the window, and not at all when they
+				have all submitted (or when it is the only one), then runs the
+				classifier while the next requests queue up for the next batch.
+				Only one batch runs at a time, so the classifier never sees two
+				threads.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef BatchScheduler_H_
+#define BatchScheduler_H_
+
+#include "DigitClassifier.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// What the scheduler has done so far
+typedef struct
+{
+	long long batches;		// runs of the classifier
+	long long requests;		// predict calls of the streams
+	long long tiles;		// tiles classified (skipped ones are not sent)
+	double waitMs;			// time the leaders spent waiting for the other streams
+	double inferenceMs;		// time spent in the classifier
+} BatchStats;
+
+class BatchScheduler
+{
+public:
+	/**
+	* @param classifier loaded classifier, owned and used by one thread at a time from now on
+	* @param windowMs longest a batch waits for the other streams after its first request
+	* @param maxTiles a batch with that many tiles runs without waiting any longer
+	*/
+	BatchScheduler(std::unique_ptr<DigitClassifier> classifier, double windowMs, int maxTiles);
+
+	/**
+	* A DigitClassifier for one stream, e.g. for SudokuAR::setClassifier. The stream is
+	* waited for while it exists. The scheduler must outlive it
+	*/
+	std::unique_ptr<DigitClassifier> createClient();
+
+	bool isLoaded() const;
+
+	// DigitClassifier::predict, batched with the requests of the other streams. Blocks until answered.
+	// If the classifier throws, the batch is answered with -1 and its leader gets the exception
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL);
+
+	BatchStats stats() const;
+
+private:
+	class Client;
+
+	typedef struct
+	{
+		const unsigned char* tiles;
+		const bool* skip;
+		int count;
+		int* digits;
+		float* confidences;
+		bool isDone;
+	} Request;
+
+	void runBatch(std::unique_lock<std::mutex>& lock);
+	void addClient(int change);
+
+	std::unique_ptr<DigitClassifier> m_classifier;
+	double m_windowMs;
+	int m_maxTiles;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_changed; // a request came, a stream left or a batch is done
+	std::vector<Request*> m_pending; // requests of the next batch
+	int m_pendingTiles;
+	int m_clients;
+	bool m_hasLeader; // a batch is being gathered or classified
+
+	// Used by the leader only, outside of the lock
+	std::vector<unsigned char> m_batch;
+	std::vector<int> m_digits;
+	std::vector<float> m_confidences;
+
+	BatchStats m_stats;
+};
+
+#endif // !BatchScheduler_H_
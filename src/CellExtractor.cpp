@@ -0,0 +1,484 @@
+/**
+	CellExtractor.cpp
+	Purpose:	* Implements the fused extraction of the 81 cell tiles. The projection
+				from every tile to the frame is composed once per cell, and every
+				tile pixel is sampled directly from the frame: no warped grid,
+				no resized copy and no per-cell cv::Mat in between.
+				* Rows of a tile are sampled 8 pixels at a time with AVX2 when the
+				compiler targets it, and with plain C++ otherwise.
+				* The borders left in the tiles are found from the ink profiles of
+				their rows and columns, a whole row at a time with SSE2.
+				* Empty cells are found from an integral image of the ink of all
+				the tiles, in constant time per cell.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "CellExtractor.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <bitset>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const int CELLS_PER_SIDE = 9;
+
+	// Value of the tile pixels that fall outside of the frame (same as cv::warpPerspective)
+	const int BORDER_VALUE = 0;
+
+	// A tile with less contrast than this is blank: no line, no border
+	const int MIN_BORDER_CONTRAST = 40;
+	// Rows (columns) with at least this many line pixels belong to a border
+	const int MIN_BORDER_INK = CELL_SIZE / 3;
+	// The border is never thicker than this
+	const int MAX_BORDER = CELL_SIZE / 5;
+
+	// Pixels left out, inside the borders, before looking for ink
+	const int BLANK_INNER_MARGIN = 2;
+	// Below this ink ratio the cell is empty
+	const double BLANK_MAX_INK = 0.01;
+	// Below this ink ratio the cell is empty if the ink is off-center or in a single spot
+	const double BLANK_SPARSE_INK = 0.04;
+	const double BLANK_MAX_OFFSET = 0.4; // centroid to center, in thirds of the region
+	const double BLANK_MIN_SPREAD = 0.2; // in thirds of the region
+
+	/**
+	* Projection from the tile pixels to the unit square of the cell, leaving out 'margin'
+	* on every side. Tile pixel 'i' is sampled at its center
+	*/
+	cv::Matx33d tileToCell(double margin)
+	{
+		double scale = (1.0 - 2.0 * margin) / CELL_SIZE;
+		double offset = margin + 0.5 * scale;
+		return cv::Matx33d(
+			scale, 0, offset,
+			0, scale, offset,
+			0, 0, 1);
+	}
+
+	int sampleScalar(const cv::Mat& frame, float x, float y)
+	{
+		float fx = floorf(x);
+		float fy = floorf(y);
+		if (fx < 0 || fx >= frame.cols - 1 || fy < 0 || fy >= frame.rows - 1)
+			return BORDER_VALUE;
+
+		float ax = x - fx;
+		float ay = y - fy;
+		const unsigned char* p = frame.data + (int)fy * frame.step + (int)fx;
+
+		float top = p[0] + ax * (p[1] - p[0]);
+		p += frame.step;
+		float bottom = p[0] + ax * (p[1] - p[0]);
+
+		return (int)(top + ay * (bottom - top) + 0.5f);
+	}
+
+	void sampleTile(const cv::Mat& frame, const cv::Matx33d& h, unsigned char* tile)
+	{
+#ifdef __AVX2__
+		const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 maxX = _mm256_set1_ps((float)(frame.cols - 1));
+		const __m256 maxY = _mm256_set1_ps((float)(frame.rows - 1));
+		const __m256i step = _mm256_set1_epi32((int)frame.step);
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256i border = _mm256_set1_epi32(BORDER_VALUE);
+
+		// 4 bytes are read per gathered pixel pair, which must stay inside the frame buffer
+		const __m256i safeIndex = _mm256_set1_epi32((int)(frame.dataend - frame.data) - 4 - (int)frame.step);
+		const int* base = (const int*)frame.data;
+
+		const __m256 dX = _mm256_set1_ps((float)h(0, 0));
+		const __m256 dY = _mm256_set1_ps((float)h(1, 0));
+		const __m256 dW = _mm256_set1_ps((float)h(2, 0));
+
+		int values[8];
+		for (int j = 0; j < CELL_SIZE; j++)
+		{
+			unsigned char* out = tile + j * CELL_SIZE;
+			for (int i = 0; i < CELL_SIZE; i += 8)
+			{
+				__m256 u = _mm256_add_ps(lane, _mm256_set1_ps((float)i));
+				__m256 X = _mm256_add_ps(_mm256_set1_ps((float)(h(0, 1) * j + h(0, 2))), _mm256_mul_ps(u, dX));
+				__m256 Y = _mm256_add_ps(_mm256_set1_ps((float)(h(1, 1) * j + h(1, 2))), _mm256_mul_ps(u, dY));
+				__m256 W = _mm256_add_ps(_mm256_set1_ps((float)(h(2, 1) * j + h(2, 2))), _mm256_mul_ps(u, dW));
+
+				__m256 x = _mm256_div_ps(X, W);
+				__m256 y = _mm256_div_ps(Y, W);
+				__m256 fx = _mm256_floor_ps(x);
+				__m256 fy = _mm256_floor_ps(y);
+				__m256 ax = _mm256_sub_ps(x, fx);
+				__m256 ay = _mm256_sub_ps(y, fy);
+
+				__m256 inside = _mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(fx, zero, _CMP_GE_OQ), _mm256_cmp_ps(fx, maxX, _CMP_LT_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(fy, zero, _CMP_GE_OQ), _mm256_cmp_ps(fy, maxY, _CMP_LT_OQ)));
+				__m256i valid = _mm256_castps_si256(inside);
+
+				__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(fy), step), _mm256_cvttps_epi32(fx));
+				index = _mm256_and_si256(index, valid);
+
+				__m256i overrun = _mm256_and_si256(_mm256_cmpgt_epi32(index, safeIndex), valid);
+				__m256i gatherMask = _mm256_andnot_si256(overrun, valid);
+
+				__m256i upperPair = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, gatherMask, 1);
+				__m256i lowerPair = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base,
+					_mm256_add_epi32(index, step), gatherMask, 1);
+
+				__m256 p00 = _mm256_cvtepi32_ps(_mm256_and_si256(upperPair, byteMask));
+				__m256 p01 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(upperPair, 8), byteMask));
+				__m256 p10 = _mm256_cvtepi32_ps(_mm256_and_si256(lowerPair, byteMask));
+				__m256 p11 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(lowerPair, 8), byteMask));
+
+				__m256 top = _mm256_add_ps(_mm256_mul_ps(ax, _mm256_sub_ps(p01, p00)), p00);
+				__m256 bottom = _mm256_add_ps(_mm256_mul_ps(ax, _mm256_sub_ps(p11, p10)), p10);
+				__m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ay, _mm256_sub_ps(bottom, top)), top), half);
+
+				__m256i result = _mm256_blendv_epi8(border, _mm256_cvttps_epi32(value), valid);
+				_mm256_storeu_si256((__m256i*)values, result);
+
+				// Lanes whose 4-byte read would run past the end of the frame are done one by one
+				if (!_mm256_testz_si256(overrun, overrun))
+				{
+					int lanes[8];
+					float xs[8], ys[8];
+					_mm256_storeu_si256((__m256i*)lanes, overrun);
+					_mm256_storeu_ps(xs, x);
+					_mm256_storeu_ps(ys, y);
+					for (int l = 0; l < 8; l++)
+					{
+						if (lanes[l] != 0)
+							values[l] = sampleScalar(frame, xs[l], ys[l]);
+					}
+				}
+
+				int count = (CELL_SIZE - i < 8) ? CELL_SIZE - i : 8;
+				for (int l = 0; l < count; l++)
+					out[i + l] = (unsigned char)values[l];
+			}
+		}
+#else
+		for (int j = 0; j < CELL_SIZE; j++)
+		{
+			unsigned char* out = tile + j * CELL_SIZE;
+
+			double X = h(0, 1) * j + h(0, 2);
+			double Y = h(1, 1) * j + h(1, 2);
+			double W = h(2, 1) * j + h(2, 2);
+
+			for (int i = 0; i < CELL_SIZE; i++)
+			{
+				out[i] = (unsigned char)sampleScalar(frame, (float)(X / W), (float)(Y / W));
+
+				X += h(0, 0);
+				Y += h(1, 0);
+				W += h(2, 0);
+			}
+		}
+#endif
+	}
+
+	/**
+	* Counts the line pixels of every row and column of a tile. Line pixels are darker
+	* (darkLines) or brighter than 'threshold'
+	*/
+	void inkProfiles(const unsigned char* tile, bool darkLines, int threshold,
+		int rowInk[CELL_SIZE], int colInk[CELL_SIZE])
+	{
+#ifdef __SSE2__
+		// Unsigned compare through the signed one
+		const __m128i sign = _mm_set1_epi8((char)0x80);
+		const __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+
+		// Every row is read as columns [0, 16) and [CELL_SIZE - 16, CELL_SIZE)
+		const int secondOffset = CELL_SIZE - 16;
+		const int secondOnlyBits = 0xFFFF & ~((1 << (16 - secondOffset)) - 1);
+
+		__m128i firstCols = _mm_setzero_si128();
+		__m128i secondCols = _mm_setzero_si128();
+
+		for (int j = 0; j < CELL_SIZE; j++)
+		{
+			const unsigned char* row = tile + j * CELL_SIZE;
+			__m128i first = _mm_xor_si128(_mm_loadu_si128((const __m128i*)row), sign);
+			__m128i second = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(row + secondOffset)), sign);
+
+			__m128i firstInk = darkLines ? _mm_cmpgt_epi8(limit, first) : _mm_cmpgt_epi8(first, limit);
+			__m128i secondInk = darkLines ? _mm_cmpgt_epi8(limit, second) : _mm_cmpgt_epi8(second, limit);
+
+			rowInk[j] = (int)std::bitset<16>(_mm_movemask_epi8(firstInk)).count()
+				+ (int)std::bitset<16>(_mm_movemask_epi8(secondInk) & secondOnlyBits).count();
+
+			// Masks are -1 where there is ink: subtracting them counts it (at most CELL_SIZE, fits a byte)
+			firstCols = _mm_sub_epi8(firstCols, firstInk);
+			secondCols = _mm_sub_epi8(secondCols, secondInk);
+		}
+
+		unsigned char first[16], second[16];
+		_mm_storeu_si128((__m128i*)first, firstCols);
+		_mm_storeu_si128((__m128i*)second, secondCols);
+		for (int i = 0; i < CELL_SIZE; i++)
+			colInk[i] = (i < 16) ? first[i] : second[i - secondOffset];
+#else
+		for (int i = 0; i < CELL_SIZE; i++)
+			colInk[i] = 0;
+
+		for (int j = 0; j < CELL_SIZE; j++)
+		{
+			const unsigned char* row = tile + j * CELL_SIZE;
+			rowInk[j] = 0;
+			for (int i = 0; i < CELL_SIZE; i++)
+			{
+				bool isInk = darkLines ? (row[i] < threshold) : (row[i] > threshold);
+				rowInk[j] += isInk;
+				colInk[i] += isInk;
+			}
+		}
+#endif
+	}
+
+	// Number of leading entries of 'ink' (walking by 'step' from 'first') that belong to a border
+	int borderWidth(const int* ink, int first, int step)
+	{
+		int width = 0;
+		while (width < MAX_BORDER && ink[first + width * step] >= MIN_BORDER_INK)
+			width++;
+
+		// The blurred edge of the line goes too
+		if (width > 0 && width < MAX_BORDER)
+			width++;
+
+		return width;
+	}
+
+	cv::Rect tileBorders(const unsigned char* tile, bool darkLines)
+	{
+		cv::Rect roi(0, 0, CELL_SIZE, CELL_SIZE);
+
+		int minValue, maxValue;
+#ifdef __SSE2__
+		__m128i minVec = _mm_set1_epi8((char)0xFF);
+		__m128i maxVec = _mm_setzero_si128();
+		for (int j = 0; j < CELL_SIZE; j++)
+		{
+			const unsigned char* row = tile + j * CELL_SIZE;
+			__m128i first = _mm_loadu_si128((const __m128i*)row);
+			__m128i second = _mm_loadu_si128((const __m128i*)(row + CELL_SIZE - 16));
+			minVec = _mm_min_epu8(minVec, _mm_min_epu8(first, second));
+			maxVec = _mm_max_epu8(maxVec, _mm_max_epu8(first, second));
+		}
+
+		unsigned char mins[16], maxs[16];
+		_mm_storeu_si128((__m128i*)mins, minVec);
+		_mm_storeu_si128((__m128i*)maxs, maxVec);
+		minValue = mins[0];
+		maxValue = maxs[0];
+		for (int i = 1; i < 16; i++)
+		{
+			minValue = std::min(minValue, (int)mins[i]);
+			maxValue = std::max(maxValue, (int)maxs[i]);
+		}
+#else
+		minValue = 255;
+		maxValue = 0;
+		for (int i = 0; i < CELL_PIXELS; i++)
+		{
+			minValue = std::min(minValue, (int)tile[i]);
+			maxValue = std::max(maxValue, (int)tile[i]);
+		}
+#endif
+
+		if (maxValue - minValue < MIN_BORDER_CONTRAST)
+			return roi;
+
+		int rowInk[CELL_SIZE], colInk[CELL_SIZE];
+		inkProfiles(tile, darkLines, (minValue + maxValue) / 2, rowInk, colInk);
+
+		int top = borderWidth(rowInk, 0, 1);
+		int bottom = borderWidth(rowInk, CELL_SIZE - 1, -1);
+		int left = borderWidth(colInk, 0, 1);
+		int right = borderWidth(colInk, CELL_SIZE - 1, -1);
+
+		roi.x = left;
+		roi.y = top;
+		roi.width = CELL_SIZE - left - right;
+		roi.height = CELL_SIZE - top - bottom;
+		return roi;
+	}
+
+	// Sum of the 'ink' whose integral image is 'sum' over 'r'
+	inline int rectSum(const cv::Mat& sum, const cv::Rect& r)
+	{
+		return sum.at<int>(r.y + r.height, r.x + r.width) - sum.at<int>(r.y, r.x + r.width)
+			- sum.at<int>(r.y + r.height, r.x) + sum.at<int>(r.y, r.x);
+	}
+
+	bool isBlank(const cv::Mat& sum, const cv::Rect& inner)
+	{
+		if (inner.width <= 0 || inner.height <= 0)
+			return false;
+		int area = inner.width * inner.height;
+
+		double inkRatio = rectSum(sum, inner) / (double)area;
+		if (inkRatio < BLANK_MAX_INK)
+			return true;
+		if (inkRatio >= BLANK_SPARSE_INK)
+			return false;
+
+		// Little ink: look at how it is spread over 3 x 3 blocks. A digit covers the middle,
+		// leftovers of a grid line or a speck of dirt do not
+		double total = 0, meanX = 0, meanY = 0, meanXX = 0, meanYY = 0;
+		for (int by = 0; by < 3; by++)
+		{
+			for (int bx = 0; bx < 3; bx++)
+			{
+				int x0 = inner.x + bx * inner.width / 3, x1 = inner.x + (bx + 1) * inner.width / 3;
+				int y0 = inner.y + by * inner.height / 3, y1 = inner.y + (by + 1) * inner.height / 3;
+				double ink = rectSum(sum, cv::Rect(x0, y0, x1 - x0, y1 - y0));
+
+				total += ink;
+				meanX += ink * (bx - 1);
+				meanY += ink * (by - 1);
+				meanXX += ink * (bx - 1) * (bx - 1);
+				meanYY += ink * (by - 1) * (by - 1);
+			}
+		}
+		if (total <= 0)
+			return true;
+
+		meanX /= total; meanY /= total;
+		double offset = sqrt(meanX * meanX + meanY * meanY);
+		double spread = sqrt(std::max(0.0, meanXX / total - meanX * meanX + meanYY / total - meanY * meanY));
+
+		return offset > BLANK_MAX_OFFSET || spread < BLANK_MIN_SPREAD;
+	}
+}
+
+void CellExtractor::cellProjections(const cv::Mat& projMatInv, int gridWidth, int gridHeight, double margin,
+	cv::Matx33d tileToFrame[81])
+{
+	cv::Matx33d gridToFrame;
+	projMatInv.convertTo(gridToFrame, CV_64F);
+
+	cv::Matx33d toCell = tileToCell(margin);
+	double cellWidth = (gridWidth - 1) / (double)CELLS_PER_SIDE;
+	double cellHeight = (gridHeight - 1) / (double)CELLS_PER_SIDE;
+
+	for (int row = 0; row < CELLS_PER_SIDE; row++)
+	{
+		for (int col = 0; col < CELLS_PER_SIDE; col++)
+		{
+			// From the unit square of the cell to the straightened grid
+			cv::Matx33d cellToGrid(
+				cellWidth, 0, col * cellWidth,
+				0, cellHeight, row * cellHeight,
+				0, 0, 1);
+
+			tileToFrame[row * CELLS_PER_SIDE + col] = gridToFrame * cellToGrid * toCell;
+		}
+	}
+}
+
+void CellExtractor::cellProjections(const cv::Point2f lattice[100], double margin, cv::Matx33d tileToFrame[81])
+{
+	const int latticeLines = CELLS_PER_SIDE + 1;
+
+	cv::Matx33d toCell = tileToCell(margin);
+	cv::Point2f unitSquare[4] = { cv::Point2f(0, 0), cv::Point2f(0, 1), cv::Point2f(1, 1), cv::Point2f(1, 0) };
+
+	for (int row = 0; row < CELLS_PER_SIDE; row++)
+	{
+		for (int col = 0; col < CELLS_PER_SIDE; col++)
+		{
+			cv::Point2f frameCorners[4];
+			frameCorners[0] = lattice[row * latticeLines + col];
+			frameCorners[1] = lattice[(row + 1) * latticeLines + col];
+			frameCorners[2] = lattice[(row + 1) * latticeLines + col + 1];
+			frameCorners[3] = lattice[row * latticeLines + col + 1];
+
+			cv::Matx33d cellToFrame;
+			cv::getPerspectiveTransform(unitSquare, frameCorners).convertTo(cellToFrame, CV_64F);
+
+			tileToFrame[row * CELLS_PER_SIDE + col] = cellToFrame * toCell;
+		}
+	}
+}
+
+cv::Matx33d CellExtractor::cropProjection(const cv::Matx33d& tileToFrame, const cv::Rect& roi)
+{
+	double scaleX = roi.width / (double)CELL_SIZE;
+	double scaleY = roi.height / (double)CELL_SIZE;
+
+	// New tile pixel 'i' lands on the old tile coordinate roi.x + (i + 0.5) * scaleX - 0.5
+	cv::Matx33d crop(
+		scaleX, 0, roi.x + 0.5 * scaleX - 0.5,
+		0, scaleY, roi.y + 0.5 * scaleY - 0.5,
+		0, 0, 1);
+
+	return tileToFrame * crop;
+}
+
+void CellExtractor::sampleCells(const cv::Mat& frame, const cv::Matx33d* tileToFrame, int count,
+	unsigned char* tiles, const bool* mask)
+{
+	CV_Assert(frame.type() == CV_8UC1);
+
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; i++)
+		{
+			if (mask == NULL || mask[i])
+				sampleTile(frame, tileToFrame[i], tiles + i * CELL_PIXELS);
+		}
+	});
+}
+
+void CellExtractor::findBorders(const unsigned char* tiles, int count, bool darkLines, cv::Rect* rois)
+{
+	for (int i = 0; i < count; i++)
+		rois[i] = tileBorders(tiles + i * CELL_PIXELS, darkLines);
+}
+
+int CellExtractor::findBlankCells(const unsigned char* tiles, int count, bool darkInk, const cv::Rect* rois, bool* blank,
+	double inkThreshold, double* usedThreshold)
+{
+	// All the tiles at once, one under the other: a single threshold and a single integral image
+	cv::Mat cells(count * CELL_SIZE, CELL_SIZE, CV_8UC1, (void*)tiles);
+
+	cv::Mat ink, sum;
+	int type = darkInk ? cv::THRESH_BINARY_INV : cv::THRESH_BINARY;
+	if (inkThreshold < 0)
+		inkThreshold = cv::threshold(cells, ink, 0, 1, type | cv::THRESH_OTSU);
+	else
+		cv::threshold(cells, ink, inkThreshold, 1, type);
+	if (usedThreshold)
+		*usedThreshold = inkThreshold;
+	cv::integral(ink, sum, CV_32S);
+
+	int blankCount = 0;
+	for (int i = 0; i < count; i++)
+	{
+		cv::Rect inner(rois[i].x + BLANK_INNER_MARGIN, rois[i].y + BLANK_INNER_MARGIN,
+			rois[i].width - 2 * BLANK_INNER_MARGIN, rois[i].height - 2 * BLANK_INNER_MARGIN);
+		inner.y += i * CELL_SIZE;
+
+		blank[i] = isBlank(sum, inner);
+		if (blank[i])
+			blankCount++;
+	}
+
+	return blankCount;
+}
@@ -0,0 +1,81 @@
+/**
+	CellExtractor.h
+	Purpose:	* Samples the 81 cells of the sudoku straight from the camera frame
+				into normalized CELL_SIZE x CELL_SIZE tiles, stored one after the
+				other in a single contiguous buffer.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef CellExtractor_H_
+#define CellExtractor_H_
+
+#include "opencv2/core.hpp"
+
+// Side of the normalized tile of a cell, the input size of the digit CNN
+#define CELL_SIZE 28
+#define CELL_PIXELS (CELL_SIZE * CELL_SIZE)
+
+// Tile pixels above it are background for every digit classifier, as in use_cnn.py:
+// cv2.threshold(image, 123, 255, THRESH_BINARY_INV)
+#define INPUT_THRESHOLD 123
+
+namespace CellExtractor
+{
+	/**
+	* Projections from the tile of every cell to the frame for a flat page
+	* @param projMatInv projection from the straightened grid to the frame
+	* @param gridWidth, gridHeight size of the straightened grid
+	* @param margin part of the cell (on every side) left out of the tile
+	* @param tileToFrame output, 81 projections in row-major order
+	*/
+	void cellProjections(const cv::Mat& projMatInv, int gridWidth, int gridHeight, double margin,
+		cv::Matx33d tileToFrame[81]);
+
+	/**
+	* Projections from the tile of every cell to the frame, every cell being
+	* mapped through its own 4 grid crossings
+	* @param lattice the 10 x 10 crossings of the grid lines, row-major
+	*/
+	void cellProjections(const cv::Point2f lattice[100], double margin, cv::Matx33d tileToFrame[81]);
+
+	/**
+	* Narrows a projection so that the whole tile covers only 'roi' of what it covered before
+	*/
+	cv::Matx33d cropProjection(const cv::Matx33d& tileToFrame, const cv::Rect& roi);
+
+	/**
+	* Samples (bilinearly) 'count' tiles from the 8-bit 'frame' into 'tiles', which holds
+	* count * CELL_PIXELS bytes. Cells are processed in parallel
+	* @param mask if not NULL, only the cells with mask[i] set are sampled
+	*/
+	void sampleCells(const cv::Mat& frame, const cv::Matx33d* tileToFrame, int count,
+		unsigned char* tiles, const bool* mask = NULL);
+
+	/**
+	* Finds the remains of the grid lines along the 4 sides of 'count' contiguous tiles, from
+	* the ink profile of every row and column of the tile
+	* @param darkLines true if the lines are darker than the paper (gray), false if brighter (threshold)
+	* @param rois output, the part of every tile inside the borders. The whole tile if there is none
+	*/
+	void findBorders(const unsigned char* tiles, int count, bool darkLines, cv::Rect* rois);
+
+	/**
+	* Tells the confidently empty cells apart, before any recognition. The tiles are binarized
+	* together (Otsu) and the ink statistics of the region inside the borders of every tile
+	* are read from a single integral image: ink ratio, centroid and spread of the ink
+	* @param darkInk true if the digits are darker than the paper (gray), false if brighter (threshold)
+	* @param rois the part of every tile inside its borders (findBorders)
+	* @param blank output, whether the cell is empty
+	* @param inkThreshold gray level between paper and ink, e.g. the one found for all the tiles of the
+	* grid when a few of them are checked again. Negative: found by Otsu over these tiles
+	* @param usedThreshold output if not NULL, the gray level the tiles were binarized at
+	* @return number of empty cells
+	*/
+	int findBlankCells(const unsigned char* tiles, int count, bool darkInk, const cv::Rect* rois, bool* blank,
+		double inkThreshold = -1, double* usedThreshold = NULL);
+}
+
+#endif // !CellExtractor_H_
@@ -0,0 +1,42 @@
+/**
+	CellTensor.cpp
+	Purpose:	* Implements the contiguous tensor of the cell tiles.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "CellTensor.h"
+
+CellTensor::CellTensor(int count) :
+	m_count(count)
+{
+	size_t bytes = cv::alignSize((size_t)count * CELL_PIXELS, CELL_TENSOR_ALIGN);
+
+	// One allocation for both tensors, with room to align its start
+	m_storage.resize(bytes + (size_t)count * CELL_PIXELS * sizeof(float) + CELL_TENSOR_ALIGN);
+
+	m_data = cv::alignPtr(&m_storage[0], CELL_TENSOR_ALIGN);
+	m_floatData = (float*)(m_data + bytes);
+}
+
+cv::Mat CellTensor::cell(int i) const
+{
+	CV_Assert(i >= 0 && i < m_count);
+	return cv::Mat(CELL_SIZE, CELL_SIZE, CV_8UC1, m_data + (size_t)i * CELL_PIXELS);
+}
+
+cv::Mat CellTensor::cells() const
+{
+	return cv::Mat(m_count * CELL_SIZE, CELL_SIZE, CV_8UC1, m_data);
+}
+
+cv::Mat CellTensor::toFloat(double scale, double shift)
+{
+	// Same 2D shape on both sides, so convertTo writes into our buffer and never reallocates
+	cv::Mat floats(m_count * CELL_SIZE, CELL_SIZE, CV_32FC1, m_floatData);
+	cells().convertTo(floats, CV_32F, scale, shift);
+
+	int sizes[4] = { m_count, 1, CELL_SIZE, CELL_SIZE };
+	return cv::Mat(4, sizes, CV_32F, m_floatData);
+}
@@ -0,0 +1,63 @@
+/**
+	CellTensor.h
+	Purpose:	* Owns the tiles of the cells in a single aligned, contiguous buffer
+				laid out as a count x 1 x CELL_SIZE x CELL_SIZE (NCHW) tensor.
+				* The 8-bit tiles are what the extraction writes to; the float32
+				copy is what a batched classifier reads, without any further copy
+				or transpose. Both are allocated once and reused every frame.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef CellTensor_H_
+#define CellTensor_H_
+
+#include "opencv2/core.hpp"
+
+#include "CellExtractor.h"
+
+#include <vector>
+
+// Alignment (in bytes) of both the 8-bit and the float32 tensor, one cache line
+#define CELL_TENSOR_ALIGN 64
+
+class CellTensor
+{
+public:
+	CellTensor(int count);
+
+	int count() const { return m_count; }
+
+	// The 8-bit tiles, count * CELL_PIXELS bytes, tile 'i' starting at i * CELL_PIXELS
+	unsigned char* data() { return m_data; }
+	const unsigned char* data() const { return m_data; }
+
+	// Non-owning CELL_SIZE x CELL_SIZE CV_8UC1 view of tile 'i'
+	cv::Mat cell(int i) const;
+
+	// Non-owning (count * CELL_SIZE) x CELL_SIZE CV_8UC1 view of all the tiles, one under the other
+	cv::Mat cells() const;
+
+	/**
+	* Converts the 8-bit tiles to float32 (value * scale + shift) into the float tensor
+	* @return non-owning 4-dimensional CV_32F view: count x 1 x CELL_SIZE x CELL_SIZE
+	*/
+	cv::Mat toFloat(double scale = 1.0 / 255.0, double shift = 0.0);
+
+	// The float32 tensor as last converted by toFloat
+	const float* floatData() const { return m_floatData; }
+
+private:
+	// Views hand out pointers into the buffer, which must never move
+	CellTensor(const CellTensor&);
+	CellTensor& operator=(const CellTensor&);
+
+	int m_count;
+	std::vector<unsigned char> m_storage;
+	unsigned char* m_data;
+	float* m_floatData;
+};
+
+#endif // !CellTensor_H_
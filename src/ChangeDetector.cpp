@@ -0,0 +1,61 @@
+/**
+	ChangeDetector.cpp
+	Purpose:	* Implements the thumbnail comparison of the change detector.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "ChangeDetector.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+
+ChangeDetector::ChangeDetector(int thumbnailWidth, int pixelThreshold, double maxChangedRatio) :
+	m_thumbnailWidth(thumbnailWidth)
+	, m_pixelThreshold(pixelThreshold)
+	, m_maxChangedRatio(maxChangedRatio)
+{
+}
+
+bool ChangeDetector::hasChanged(const cv::Mat& frame, const cv::Rect& roi)
+{
+	// Downsample first, so the color conversion only touches the thumbnail
+	cv::Size size(m_thumbnailWidth, std::max(1, frame.rows * m_thumbnailWidth / std::max(1, frame.cols)));
+	cv::Mat small;
+	cv::resize(frame, small, size, 0, 0, cv::INTER_AREA);
+	if (small.channels() == 3)
+		cv::cvtColor(small, m_thumbnail, CV_BGR2GRAY);
+	else
+		m_thumbnail = small;
+
+	if (m_reference.empty() || m_reference.size() != m_thumbnail.size() || frame.size() != m_frameSize)
+	{
+		m_frameSize = frame.size();
+		return true;
+	}
+
+	// Region to watch, in thumbnail pixels
+	cv::Rect thumbRoi(0, 0, size.width, size.height);
+	if (roi.area() > 0)
+	{
+		double scale = (double)size.width / frame.cols;
+		cv::Rect scaled(cvFloor(roi.x * scale), cvFloor(roi.y * scale),
+			cvCeil(roi.width * scale) + 1, cvCeil(roi.height * scale) + 1);
+		thumbRoi &= scaled;
+		if (thumbRoi.area() == 0)
+			return true;
+	}
+
+	cv::Mat difference;
+	cv::absdiff(m_thumbnail(thumbRoi), m_reference(thumbRoi), difference);
+	int changedPixels = cv::countNonZero(difference > m_pixelThreshold);
+
+	return changedPixels > m_maxChangedRatio * thumbRoi.area();
+}
+
+void ChangeDetector::acceptFrame()
+{
+	m_thumbnail.copyTo(m_reference);
+}
@@ -0,0 +1,47 @@
+/**
+	ChangeDetector.h
+	Purpose:	* Tells whether anything moved in the camera frame since the last
+				frame that was fully processed, by comparing small luma thumbnails.
+				Costs one downsampling of the frame, so a static scene can be
+				answered from the results of the last processed frame.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef ChangeDetector_H_
+#define ChangeDetector_H_
+
+#include "opencv2/core.hpp"
+
+class ChangeDetector
+{
+public:
+	/**
+	* @param thumbnailWidth width of the thumbnails, the height follows the frame
+	* @param pixelThreshold smallest luma difference (0 ... 255) of a thumbnail pixel that counts as a change
+	* @param maxChangedRatio share of the changed thumbnail pixels inside the region above which the scene changed
+	*/
+	ChangeDetector(int thumbnailWidth, int pixelThreshold, double maxChangedRatio);
+
+	/**
+	* Compares the BGR 'frame' against the reference
+	* @param roi region of the frame to watch. The whole frame if empty
+	* @return true if the region changed, or if there is no reference yet
+	*/
+	bool hasChanged(const cv::Mat& frame, const cv::Rect& roi);
+
+	// Makes the frame of the last hasChanged call the reference
+	void acceptFrame();
+
+private:
+	int m_thumbnailWidth;
+	int m_pixelThreshold;
+	double m_maxChangedRatio;
+
+	cv::Mat m_thumbnail, m_reference;
+	cv::Size m_frameSize;
+};
+
+#endif // !ChangeDetector_H_
@@ -0,0 +1,40 @@
+/**
+	DebugRecorder.cpp
+	Purpose:	* Implements the lazy drawing of the recorded debug primitives.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "DebugRecorder.h"
+
+#include "opencv2/imgproc.hpp"
+
+void DebugRecorder::clear()
+{
+	m_primitives.clear();
+	m_points.clear();
+}
+
+void DebugRecorder::render(cv::Mat& canvas) const
+{
+	for (size_t i = 0; i < m_primitives.size(); i++)
+	{
+		const Primitive& p = m_primitives[i];
+		switch (p.type)
+		{
+		case PRIMITIVE_CIRCLE:
+			cv::circle(canvas, cv::Point((int)p.a.x, (int)p.a.y), p.radius, p.color, p.thickness, 8, 0);
+			break;
+		case PRIMITIVE_LINE:
+			cv::line(canvas, cv::Point((int)p.a.x, (int)p.a.y), cv::Point((int)p.b.x, (int)p.b.y), p.color, p.thickness, 8, 0);
+			break;
+		case PRIMITIVE_POLYGON:
+		{
+			const cv::Point* points = &m_points[p.firstPoint];
+			cv::polylines(canvas, &points, &p.numPoints, 1, true, p.color, p.thickness, 8, 0);
+			break;
+		}
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/**
+	DebugRecorder.h
+	Purpose:	* Records the debug drawings of the detector (circles, lines and
+				outlines) while a frame is processed and draws them all at once,
+				only when the debug view is shown.
+				* Built without SUDOKU_AR_DEBUG_DRAW, recording compiles to nothing:
+				no drawing and no copy of the frame to draw on.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef DebugRecorder_H_
+#define DebugRecorder_H_
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+class DebugRecorder
+{
+public:
+	void circle(const cv::Point2f& center, int radius, const cv::Scalar& color, int thickness = -1)
+	{
+#ifdef SUDOKU_AR_DEBUG_DRAW
+		Primitive p = { PRIMITIVE_CIRCLE, center, center, radius, color, thickness, 0, 0 };
+		m_primitives.push_back(p);
+#endif
+	}
+
+	void line(const cv::Point2f& from, const cv::Point2f& to, const cv::Scalar& color, int thickness = 1)
+	{
+#ifdef SUDOKU_AR_DEBUG_DRAW
+		Primitive p = { PRIMITIVE_LINE, from, to, 0, color, thickness, 0, 0 };
+		m_primitives.push_back(p);
+#endif
+	}
+
+	// Closed outline through 'count' points
+	void polygon(const cv::Point* points, int count, const cv::Scalar& color, int thickness = 1)
+	{
+#ifdef SUDOKU_AR_DEBUG_DRAW
+		Primitive p = { PRIMITIVE_POLYGON, cv::Point2f(), cv::Point2f(), 0, color, thickness, (int)m_points.size(), count };
+		m_points.insert(m_points.end(), points, points + count);
+		m_primitives.push_back(p);
+#endif
+	}
+
+	// Forgets the drawings of the last frame
+	void clear();
+
+	// Draws everything recorded since the last clear on 'canvas'
+	void render(cv::Mat& canvas) const;
+
+private:
+	enum PrimitiveType
+	{
+		PRIMITIVE_CIRCLE = 0,
+		PRIMITIVE_LINE,
+		PRIMITIVE_POLYGON
+	};
+
+	typedef struct
+	{
+		PrimitiveType type;
+		cv::Point2f a, b;	// center (circle) or end points (line)
+		int radius;
+		cv::Scalar color;
+		int thickness;
+		int firstPoint;		// polygon: its points are m_points[firstPoint ... firstPoint + numPoints)
+		int numPoints;
+	} Primitive;
+
+	std::vector<Primitive> m_primitives;
+	std::vector<cv::Point> m_points;
+};
+
+#endif // !DebugRecorder_H_
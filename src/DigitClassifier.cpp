@@ -0,0 +1,65 @@
+/**
+	DigitClassifier.cpp
+	Purpose:	* Creates the digit classifier of a backend.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "DigitClassifier.h"
+#include "DigitCnn.h"
+#include "DigitStudent.h"
+#include "DnnClassifier.h"
+#include "HogClassifier.h"
+#include "RemoteClassifier.h"
+
+std::unique_ptr<DigitClassifier> DigitClassifier::create(DigitBackend backend)
+{
+	switch (backend)
+	{
+	case DIGIT_BACKEND_DNN:
+		return std::unique_ptr<DigitClassifier>(new DnnClassifier());
+	case DIGIT_BACKEND_HOG:
+		return std::unique_ptr<DigitClassifier>(new HogClassifier());
+	case DIGIT_BACKEND_STUDENT:
+		return std::unique_ptr<DigitClassifier>(new DigitStudent());
+	case DIGIT_BACKEND_REMOTE:
+		return std::unique_ptr<DigitClassifier>(new RemoteClassifier());
+	default:
+		return std::unique_ptr<DigitClassifier>(new DigitCnn());
+	}
+}
+
+const char* DigitClassifier::backendName(DigitBackend backend)
+{
+	switch (backend)
+	{
+	case DIGIT_BACKEND_DNN:
+		return "cv::dnn";
+	case DIGIT_BACKEND_HOG:
+		return "HOG + SVM";
+	case DIGIT_BACKEND_STUDENT:
+		return "DigitStudent";
+	case DIGIT_BACKEND_REMOTE:
+		return "recognition server";
+	default:
+		return "DigitCnn";
+	}
+}
+
+const char* DigitClassifier::defaultModelPath(DigitBackend backend)
+{
+	switch (backend)
+	{
+	case DIGIT_BACKEND_DNN:
+		return "./scripts/trained_net/digit_cnn.onnx";
+	case DIGIT_BACKEND_HOG:
+		return "./scripts/trained_net/digit_hog.model";
+	case DIGIT_BACKEND_STUDENT:
+		return "./scripts/trained_net/digit_student.model";
+	case DIGIT_BACKEND_REMOTE:
+		return REMOTE_SOCKET_PATH;
+	default:
+		return "./scripts/trained_net/digit_cnn.model";
+	}
+}
@@ -0,0 +1,66 @@
+/**
+	DigitClassifier.h
+	Purpose:	* Interface of the digit recognizers the detector can run on the
+				contiguous batch of 28 x 28 tiles of the CellTensor.
+				* Backends: DigitCnn (the network of scripts/training_cnn.py, in
+				process), DnnClassifier (an ONNX or TensorFlow export of it, run
+				by cv::dnn), HogClassifier (HOG features and a linear SVM, for
+				clean printed digits), DigitStudent (a small network distilled
+				from it, for low-power stations) and RemoteClassifier (the Keras
+				network, kept loaded by scripts/recognition_server.py). One is picked at
+				run time by the SudokuConfig.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef DigitClassifier_H_
+#define DigitClassifier_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+enum DigitBackend
+{
+	DIGIT_BACKEND_CNN = 0,	// DigitCnn, model file of scripts/export_cnn.py or scripts/quantize_cnn.py
+	DIGIT_BACKEND_DNN,		// DnnClassifier, .onnx of scripts/export_onnx.py or a frozen TensorFlow .pb
+	DIGIT_BACKEND_HOG,		// HogClassifier, model file of scripts/train_hog.py
+	DIGIT_BACKEND_STUDENT,	// DigitStudent, model file of scripts/distill_student.py
+	DIGIT_BACKEND_REMOTE,	// RemoteClassifier, the "model" is the socket of scripts/recognition_server.py
+	NUM_DIGIT_BACKENDS
+};
+
+class DigitClassifier
+{
+public:
+	virtual ~DigitClassifier() {}
+
+	// New, unloaded classifier of the given backend
+	static std::unique_ptr<DigitClassifier> create(DigitBackend backend);
+
+	static const char* backendName(DigitBackend backend);
+
+	// Model the backend reads when the configuration names none
+	static const char* defaultModelPath(DigitBackend backend);
+
+	/**
+	* Reads the model of the backend
+	* @return false if the file can't be read or doesn't hold the expected model
+	*/
+	virtual bool load(const std::string& path) = 0;
+
+	virtual bool isLoaded() const = 0;
+
+	/**
+	* Classifies a batch of 8-bit tiles, prepared the way use_cnn.py prepares the PNGs
+	* @param tiles count tiles of CELL_PIXELS bytes each, one after the other
+	* @param skip tiles not to classify (may be NULL), their digit is -1
+	* @param digits out: most likely class of every tile
+	* @param confidences out (may be NULL): probability of that class
+	*/
+	virtual void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) = 0;
+};
+
+#endif // !DigitClassifier_H_
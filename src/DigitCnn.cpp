@@ -0,0 +1,843 @@
+/**
+	DigitCnn.cpp
+	Purpose:	* Implements the forward pass of the digit network. The activations
+				are kept channels_last like the kernels, so the innermost loops
+				run over contiguous output channels and vectorize.
+				* The int8 layers multiply groups of 4 unsigned activations with
+				the 4 packed weights of every output channel: one maddubs + madd
+				(or one dpbusd with VNNI) per 8 output channels.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "DigitCnn.h"
+
+#include "opencv2/core.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	const int KERNEL = 3;
+
+	const int CONV1_SIZE = CELL_SIZE - KERNEL + 1;	// 26
+	const int CONV1_CHANNELS = 32;
+	const int CONV2_SIZE = CONV1_SIZE - KERNEL + 1;	// 24
+	const int CONV2_CHANNELS = 64;
+	const int POOL_SIZE = CONV2_SIZE / 2;			// 12
+	const int FEATURES = POOL_SIZE * POOL_SIZE * CONV2_CHANNELS;
+	const int HIDDEN = 128;
+
+	const size_t CONV1_WEIGHTS = KERNEL * KERNEL * CONV1_CHANNELS;
+	const size_t CONV2_WEIGHTS = KERNEL * KERNEL * CONV1_CHANNELS * CONV2_CHANNELS;
+	const size_t DENSE1_WEIGHTS = (size_t)FEATURES * HIDDEN;
+	const size_t DENSE2_WEIGHTS = HIDDEN * DIGIT_CLASSES;
+
+	// Tiles classified together by the dense layers, so every row of the weights is read once per block
+	const int DENSE_BLOCK = 16;
+
+	// Quantized layers: inputs are multiplied in groups of 4, activations are 0 ... 127
+	const int GROUP = 4;
+	const int CONV2_GROUPS = KERNEL * KERNEL * CONV1_CHANNELS / GROUP;	// 72
+	const int DENSE1_GROUPS = FEATURES / GROUP;							// 2304
+	const int MAX_ACTIVATION = 127;
+
+	// Winograd F(2 x 2, 3 x 3): every 4 x 4 input tile gives 2 x 2 outputs with 16 products instead of 36
+	const int WINOGRAD_POINTS = 16;
+	const int WINOGRAD_BLOCK = 4;		// conv 2 tiles transformed and multiplied together
+	const int RING_ROWS = 4;			// conv 1 rows kept for conv 2, two tile rows
+	const int CONV1_RING = RING_ROWS * CONV1_SIZE * CONV1_CHANNELS;
+	const int WINOGRAD_SCRATCH = CONV1_RING + WINOGRAD_POINTS * WINOGRAD_BLOCK * (CONV1_CHANNELS + CONV2_CHANNELS);	// 37 KB
+
+#ifdef __AVX2__
+	// Register block of the conv 2 and dense 1 kernels: 4 neighboring pixels (or 4 tiles)
+	// x 16 output channels, 8 accumulators that stay in registers
+	const int BLOCK_ROWS = 4;
+	const int BLOCK_OUTPUTS = 16;
+
+	// acc + the products of the 4 unsigned bytes and the 4 signed bytes of every 32-bit lane
+	inline __m256i dotAccumulate(__m256i acc, __m256i activations, __m256i weights)
+	{
+#if defined(__AVXVNNI__)
+		return _mm256_dpbusd_avx_epi32(acc, activations, weights);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+		return _mm256_dpbusd_epi32(acc, activations, weights);
+#else
+		// Two products of at most 127 * 127 each: the 16-bit sums of maddubs never saturate
+		__m256i pairs = _mm256_maddubs_epi16(activations, weights);
+		return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+#endif
+	}
+
+	// 4 consecutive activations, in every 32-bit lane
+	inline __m256i broadcastGroup(const unsigned char* activations)
+	{
+		int group;
+		memcpy(&group, activations, sizeof(group));
+		return _mm256_set1_epi32(group);
+	}
+
+	// Winograd input transform B^T d B of 8 channels at once: 'rows' point at the first
+	// column of the 4 input rows, the columns are 'colStride' apart
+	inline void transformInput8(const float* const rows[4], int colStride, float* v, int pointStride)
+	{
+		__m256 t[4][4];
+		for (int c = 0; c < 4; c++)
+		{
+			__m256 d0 = _mm256_loadu_ps(rows[0] + c * colStride), d1 = _mm256_loadu_ps(rows[1] + c * colStride);
+			__m256 d2 = _mm256_loadu_ps(rows[2] + c * colStride), d3 = _mm256_loadu_ps(rows[3] + c * colStride);
+			t[0][c] = _mm256_sub_ps(d0, d2);
+			t[1][c] = _mm256_add_ps(d1, d2);
+			t[2][c] = _mm256_sub_ps(d2, d1);
+			t[3][c] = _mm256_sub_ps(d1, d3);
+		}
+		for (int r = 0; r < 4; r++)
+		{
+			_mm256_storeu_ps(v + (r * 4 + 0) * pointStride, _mm256_sub_ps(t[r][0], t[r][2]));
+			_mm256_storeu_ps(v + (r * 4 + 1) * pointStride, _mm256_add_ps(t[r][1], t[r][2]));
+			_mm256_storeu_ps(v + (r * 4 + 2) * pointStride, _mm256_sub_ps(t[r][2], t[r][1]));
+			_mm256_storeu_ps(v + (r * 4 + 3) * pointStride, _mm256_sub_ps(t[r][1], t[r][3]));
+		}
+	}
+
+	// Winograd output transform A^T m A of 8 channels at once, into the 2 x 2 outputs
+	inline void transformOutput8(const float* m, int pointStride, __m256 y[4])
+	{
+		__m256 s[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			__m256 m0 = _mm256_loadu_ps(m + c * pointStride), m1 = _mm256_loadu_ps(m + (4 + c) * pointStride);
+			__m256 m2 = _mm256_loadu_ps(m + (8 + c) * pointStride), m3 = _mm256_loadu_ps(m + (12 + c) * pointStride);
+			s[0][c] = _mm256_add_ps(_mm256_add_ps(m0, m1), m2);
+			s[1][c] = _mm256_sub_ps(_mm256_sub_ps(m1, m2), m3);
+		}
+		for (int r = 0; r < 2; r++)
+		{
+			y[r * 2 + 0] = _mm256_add_ps(_mm256_add_ps(s[r][0], s[r][1]), s[r][2]);
+			y[r * 2 + 1] = _mm256_sub_ps(_mm256_sub_ps(s[r][1], s[r][2]), s[r][3]);
+		}
+	}
+#endif
+
+	// Real value (>= 0) to a 7-bit activation
+	inline unsigned char toActivation(float value)
+	{
+		return (unsigned char)std::min((float)MAX_ACTIVATION, std::max(0.0f, value) + 0.5f);
+	}
+}
+
+DigitCnn::DigitCnn() :
+	m_isLoaded(false)
+	, m_isQuantized(false)
+{
+}
+
+size_t DigitCnn::parameterCount()
+{
+	return CONV1_WEIGHTS + CONV1_CHANNELS + CONV2_WEIGHTS + CONV2_CHANNELS
+		+ DENSE1_WEIGHTS + HIDDEN + DENSE2_WEIGHTS + DIGIT_CLASSES;
+}
+
+bool DigitCnn::load(const std::string& path)
+{
+	m_isLoaded = false;
+	if (!m_modelFile.open(path))
+		return false;
+
+	if (m_modelFile.hasTensor("conv2.qkernel"))
+		return loadQuantized(path);
+
+	DigitCnnWeights weights;
+	weights.conv1Kernel = m_modelFile.floats("conv1.kernel", CONV1_WEIGHTS);
+	weights.conv1Bias = m_modelFile.floats("conv1.bias", CONV1_CHANNELS);
+	weights.conv2Kernel = m_modelFile.floats("conv2.kernel", CONV2_WEIGHTS);
+	weights.conv2Bias = m_modelFile.floats("conv2.bias", CONV2_CHANNELS);
+	weights.dense1Kernel = m_modelFile.floats("dense1.kernel", DENSE1_WEIGHTS);
+	weights.dense1Bias = m_modelFile.floats("dense1.bias", HIDDEN);
+	weights.dense2Kernel = m_modelFile.floats("dense2.kernel", DENSE2_WEIGHTS);
+	weights.dense2Bias = m_modelFile.floats("dense2.bias", DIGIT_CLASSES);
+
+	if (!weights.conv1Kernel || !weights.conv1Bias || !weights.conv2Kernel || !weights.conv2Bias
+		|| !weights.dense1Kernel || !weights.dense1Bias || !weights.dense2Kernel || !weights.dense2Bias)
+	{
+		std::cout << path << " is not a digit network" << std::endl;
+		m_modelFile.close();
+		return false;
+	}
+
+	setWeights(weights);
+	return true;
+}
+
+bool DigitCnn::loadQuantized(const std::string& path)
+{
+	DigitCnnWeights weights = {};
+	weights.conv1Kernel = m_modelFile.floats("conv1.kernel", CONV1_WEIGHTS);
+	weights.conv1Bias = m_modelFile.floats("conv1.bias", CONV1_CHANNELS);
+	weights.dense1Bias = m_modelFile.floats("dense1.bias", HIDDEN);
+	weights.dense2Kernel = m_modelFile.floats("dense2.kernel", DENSE2_WEIGHTS);
+	weights.dense2Bias = m_modelFile.floats("dense2.bias", DIGIT_CLASSES);
+
+	DigitCnnQuantizedWeights quantized;
+	const float* conv1Scale = m_modelFile.floats("conv1.scale", 1);
+	quantized.conv2Kernel = m_modelFile.int8s("conv2.qkernel", CONV2_WEIGHTS);
+	quantized.conv2Multiplier = m_modelFile.floats("conv2.multiplier", CONV2_CHANNELS);
+	quantized.conv2Offset = m_modelFile.floats("conv2.offset", CONV2_CHANNELS);
+	quantized.dense1Kernel = m_modelFile.int8s("dense1.qkernel", DENSE1_WEIGHTS);
+	quantized.dense1Multiplier = m_modelFile.floats("dense1.multiplier", HIDDEN);
+
+	if (!weights.conv1Kernel || !weights.conv1Bias || !weights.dense1Bias || !weights.dense2Kernel || !weights.dense2Bias
+		|| !conv1Scale || !quantized.conv2Kernel || !quantized.conv2Multiplier || !quantized.conv2Offset
+		|| !quantized.dense1Kernel || !quantized.dense1Multiplier)
+	{
+		std::cout << path << " is not a quantized digit network" << std::endl;
+		m_modelFile.close();
+		return false;
+	}
+	quantized.conv1Scale = *conv1Scale;
+
+	setQuantizedWeights(weights, quantized);
+	return true;
+}
+
+void DigitCnn::setWeights(const DigitCnnWeights& weights)
+{
+	m_weights = weights;
+	m_isQuantized = false;
+	m_isLoaded = true;
+
+	prepareWinograd();
+}
+
+void DigitCnn::setQuantizedWeights(const DigitCnnWeights& weights, const DigitCnnQuantizedWeights& quantized)
+{
+	m_weights = weights;
+	m_quantized = quantized;
+	m_isQuantized = true;
+	m_isLoaded = true;
+}
+
+void DigitCnn::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	CV_Assert(m_isLoaded);
+
+	// Only the tiles to classify, in order
+	std::vector<int> indices;
+	for (int i = 0; i < count; i++)
+	{
+		digits[i] = -1;
+		if (confidences)
+			confidences[i] = 0;
+		if (!skip || !skip[i])
+			indices.push_back(i);
+	}
+	int numTiles = (int)indices.size();
+	if (numTiles == 0)
+		return;
+
+	if (m_isQuantized)
+		m_quantizedFeatures.resize((size_t)numTiles * FEATURES);
+	else
+		m_features.resize((size_t)numTiles * FEATURES);
+
+	// The convolutions of every tile are independent
+	cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range& range) {
+		if (m_isQuantized)
+		{
+			std::vector<unsigned char> conv1((size_t)CONV1_SIZE * CONV1_SIZE * CONV1_CHANNELS);
+			std::vector<unsigned char> conv2((size_t)CONV2_SIZE * CONV2_SIZE * CONV2_CHANNELS);
+			for (int t = range.start; t < range.end; t++)
+				computeQuantizedFeatures(tiles + (size_t)indices[t] * CELL_PIXELS, &conv1[0], &conv2[0], &m_quantizedFeatures[(size_t)t * FEATURES]);
+			return;
+		}
+
+		std::vector<float> scratch(WINOGRAD_SCRATCH);
+		for (int t = range.start; t < range.end; t++)
+			computeFeatures(tiles + (size_t)indices[t] * CELL_PIXELS, &scratch[0], &m_features[(size_t)t * FEATURES]);
+	});
+
+	// The dense layers in blocks of tiles
+	int numBlocks = (numTiles + DENSE_BLOCK - 1) / DENSE_BLOCK;
+	cv::parallel_for_(cv::Range(0, numBlocks), [&](const cv::Range& range) {
+		for (int b = range.start; b < range.end; b++)
+		{
+			int first = b * DENSE_BLOCK;
+			int blockCount = std::min(DENSE_BLOCK, numTiles - first);
+
+			int blockDigits[DENSE_BLOCK];
+			float blockConfidences[DENSE_BLOCK];
+			if (m_isQuantized)
+			{
+				const unsigned char* features[DENSE_BLOCK];
+				for (int t = 0; t < blockCount; t++)
+					features[t] = &m_quantizedFeatures[(size_t)(first + t) * FEATURES];
+				classifyQuantized(features, blockCount, blockDigits, blockConfidences);
+			}
+			else
+			{
+				const float* features[DENSE_BLOCK];
+				for (int t = 0; t < blockCount; t++)
+					features[t] = &m_features[(size_t)(first + t) * FEATURES];
+				classify(features, blockCount, blockDigits, blockConfidences);
+			}
+
+			for (int t = 0; t < blockCount; t++)
+			{
+				digits[indices[first + t]] = blockDigits[t];
+				if (confidences)
+					confidences[indices[first + t]] = blockConfidences[t];
+			}
+		}
+	});
+}
+
+void DigitCnn::prepareWinograd()
+{
+	m_winograd.assign(WINOGRAD_POINTS * (CONV1_CHANNELS + CONV1_CHANNELS * CONV2_CHANNELS), 0.0f);
+	float* u1 = &m_winograd[0];
+	float* u2 = u1 + WINOGRAD_POINTS * CONV1_CHANNELS;
+
+	float u[WINOGRAD_POINTS];
+	for (int o = 0; o < CONV1_CHANNELS; o++)
+	{
+		transformKernel(m_weights.conv1Kernel + o, CONV1_CHANNELS, u);
+		for (int p = 0; p < WINOGRAD_POINTS; p++)
+			u1[p * CONV1_CHANNELS + o] = u[p];
+	}
+
+	for (int i = 0; i < CONV1_CHANNELS; i++)
+	{
+		for (int o = 0; o < CONV2_CHANNELS; o++)
+		{
+			transformKernel(m_weights.conv2Kernel + i * CONV2_CHANNELS + o, CONV1_CHANNELS * CONV2_CHANNELS, u);
+			for (int p = 0; p < WINOGRAD_POINTS; p++)
+				u2[(p * CONV1_CHANNELS + i) * CONV2_CHANNELS + o] = u[p];
+		}
+	}
+}
+
+void DigitCnn::transformKernel(const float* g, int stride, float u[16])
+{
+	// G g, the rows of the kernel (ky) combined
+	float gg[4][KERNEL];
+	for (int c = 0; c < KERNEL; c++)
+	{
+		float g0 = g[c * stride], g1 = g[(KERNEL + c) * stride], g2 = g[(2 * KERNEL + c) * stride];
+		gg[0][c] = g0;
+		gg[1][c] = 0.5f * (g0 + g1 + g2);
+		gg[2][c] = 0.5f * (g0 - g1 + g2);
+		gg[3][c] = g2;
+	}
+
+	// (G g) G^T, the columns (kx) combined
+	for (int r = 0; r < 4; r++)
+	{
+		float a = gg[r][0], b = gg[r][1], c = gg[r][2];
+		u[r * 4 + 0] = a;
+		u[r * 4 + 1] = 0.5f * (a + b + c);
+		u[r * 4 + 2] = 0.5f * (a - b + c);
+		u[r * 4 + 3] = c;
+	}
+}
+
+void DigitCnn::computeFeatures(const unsigned char* tile, float* scratch, float* features) const
+{
+	// Conv 1 rows are computed 2 at a time, right before conv 2 needs them, into a ring of 4 rows
+	float* ring = scratch;
+	for (int ty = 0; ty < POOL_SIZE; ty++)
+	{
+		// Conv 2 tile row 'ty' reads conv 1 rows 2 ty ... 2 ty + 3
+		if (ty == 0)
+			computeConv1Row(tile, 0, ring);
+		computeConv1Row(tile, ty + 1, ring);
+
+		computeConv2Row(ring, ty, scratch + CONV1_RING, features + ty * POOL_SIZE * CONV2_CHANNELS);
+	}
+}
+
+void DigitCnn::computeConv1Row(const unsigned char* tile, int ty, float* ring) const
+{
+	const float* u1 = &m_winograd[0];
+	float* out0 = ring + ((2 * ty) % RING_ROWS) * CONV1_SIZE * CONV1_CHANNELS;
+	float* out1 = ring + ((2 * ty + 1) % RING_ROWS) * CONV1_SIZE * CONV1_CHANNELS;
+
+	for (int tx = 0; tx < CONV1_SIZE / 2; tx++)
+	{
+		// Input tile of the binary image (ink is 1) and its transform B^T d B
+		float d[4][4];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				d[r][c] = tile[(2 * ty + r) * CELL_SIZE + 2 * tx + c] > INPUT_THRESHOLD ? 0.0f : 1.0f;
+
+		float v[WINOGRAD_POINTS];
+		transformInput(&d[0][0], 4, 1, v, 1);
+
+		// One input channel: the products are the whole matrix multiplication
+		float m[WINOGRAD_POINTS][CONV1_CHANNELS];
+		for (int p = 0; p < WINOGRAD_POINTS; p++)
+			for (int o = 0; o < CONV1_CHANNELS; o++)
+				m[p][o] = v[p] * u1[p * CONV1_CHANNELS + o];
+
+		float* y0 = out0 + 2 * tx * CONV1_CHANNELS;
+		float* y1 = out1 + 2 * tx * CONV1_CHANNELS;
+#ifdef __AVX2__
+		__m256 zero = _mm256_setzero_ps();
+		for (int o = 0; o < CONV1_CHANNELS; o += 8)
+		{
+			__m256 y[4];
+			transformOutput8(&m[0][o], CONV1_CHANNELS, y);
+			__m256 bias = _mm256_loadu_ps(m_weights.conv1Bias + o);
+			_mm256_storeu_ps(y0 + o, _mm256_max_ps(zero, _mm256_add_ps(y[0], bias)));
+			_mm256_storeu_ps(y0 + CONV1_CHANNELS + o, _mm256_max_ps(zero, _mm256_add_ps(y[1], bias)));
+			_mm256_storeu_ps(y1 + o, _mm256_max_ps(zero, _mm256_add_ps(y[2], bias)));
+			_mm256_storeu_ps(y1 + CONV1_CHANNELS + o, _mm256_max_ps(zero, _mm256_add_ps(y[3], bias)));
+		}
+#else
+		for (int o = 0; o < CONV1_CHANNELS; o++)
+		{
+			float y[4];
+			transformOutput(&m[0][o], CONV1_CHANNELS, y);
+			float bias = m_weights.conv1Bias[o];
+			y0[o] = std::max(0.0f, y[0] + bias);
+			y0[CONV1_CHANNELS + o] = std::max(0.0f, y[1] + bias);
+			y1[o] = std::max(0.0f, y[2] + bias);
+			y1[CONV1_CHANNELS + o] = std::max(0.0f, y[3] + bias);
+		}
+#endif
+	}
+}
+
+void DigitCnn::computeConv2Row(const float* ring, int ty, float* scratch, float* features) const
+{
+	const float* u2 = &m_winograd[WINOGRAD_POINTS * CONV1_CHANNELS];
+	float* v = scratch;									// 16 points x 4 tiles x 32 input channels
+	float* m = scratch + WINOGRAD_POINTS * WINOGRAD_BLOCK * CONV1_CHANNELS;	// 16 points x 4 tiles x 64 output channels
+
+	const float* rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = ring + ((2 * ty + r) % RING_ROWS) * CONV1_SIZE * CONV1_CHANNELS;
+
+	for (int tx0 = 0; tx0 < POOL_SIZE; tx0 += WINOGRAD_BLOCK)
+	{
+		// Input transforms of the 4 tiles, every channel
+		for (int t = 0; t < WINOGRAD_BLOCK; t++)
+		{
+			int x = 2 * (tx0 + t);
+#ifdef __AVX2__
+			for (int i = 0; i < CONV1_CHANNELS; i += 8)
+			{
+				const float* d[4];
+				for (int r = 0; r < 4; r++)
+					d[r] = rows[r] + x * CONV1_CHANNELS + i;
+				transformInput8(d, CONV1_CHANNELS, v + t * CONV1_CHANNELS + i, WINOGRAD_BLOCK * CONV1_CHANNELS);
+			}
+#else
+			for (int i = 0; i < CONV1_CHANNELS; i++)
+			{
+				float d[4][4];
+				for (int r = 0; r < 4; r++)
+					for (int c = 0; c < 4; c++)
+						d[r][c] = rows[r][(x + c) * CONV1_CHANNELS + i];
+				transformInput(&d[0][0], 4, 1, v + t * CONV1_CHANNELS + i, WINOGRAD_BLOCK * CONV1_CHANNELS);
+			}
+#endif
+		}
+
+		// One matrix multiplication per point of the transform: (4 tiles x 32) by (32 x 64)
+		for (int p = 0; p < WINOGRAD_POINTS; p++)
+		{
+			const float* vp = v + p * WINOGRAD_BLOCK * CONV1_CHANNELS;
+			const float* up = u2 + p * CONV1_CHANNELS * CONV2_CHANNELS;
+			float* mp = m + p * WINOGRAD_BLOCK * CONV2_CHANNELS;
+#ifdef __AVX2__
+			for (int ob = 0; ob < CONV2_CHANNELS; ob += BLOCK_OUTPUTS)
+			{
+				__m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+				__m256 b0 = a0, b1 = a0, b2 = a0, b3 = a0;
+				const float* w = up + ob;
+				for (int i = 0; i < CONV1_CHANNELS; i++, w += CONV2_CHANNELS)
+				{
+					__m256 w0 = _mm256_loadu_ps(w);
+					__m256 w1 = _mm256_loadu_ps(w + 8);
+					__m256 x = _mm256_set1_ps(vp[i]);
+					a0 = _mm256_add_ps(a0, _mm256_mul_ps(x, w0));
+					b0 = _mm256_add_ps(b0, _mm256_mul_ps(x, w1));
+					x = _mm256_set1_ps(vp[CONV1_CHANNELS + i]);
+					a1 = _mm256_add_ps(a1, _mm256_mul_ps(x, w0));
+					b1 = _mm256_add_ps(b1, _mm256_mul_ps(x, w1));
+					x = _mm256_set1_ps(vp[2 * CONV1_CHANNELS + i]);
+					a2 = _mm256_add_ps(a2, _mm256_mul_ps(x, w0));
+					b2 = _mm256_add_ps(b2, _mm256_mul_ps(x, w1));
+					x = _mm256_set1_ps(vp[3 * CONV1_CHANNELS + i]);
+					a3 = _mm256_add_ps(a3, _mm256_mul_ps(x, w0));
+					b3 = _mm256_add_ps(b3, _mm256_mul_ps(x, w1));
+				}
+				float* out = mp + ob;
+				_mm256_storeu_ps(out, a0);
+				_mm256_storeu_ps(out + 8, b0);
+				out += CONV2_CHANNELS;
+				_mm256_storeu_ps(out, a1);
+				_mm256_storeu_ps(out + 8, b1);
+				out += CONV2_CHANNELS;
+				_mm256_storeu_ps(out, a2);
+				_mm256_storeu_ps(out + 8, b2);
+				out += CONV2_CHANNELS;
+				_mm256_storeu_ps(out, a3);
+				_mm256_storeu_ps(out + 8, b3);
+			}
+#else
+			// Every row of the weights is read once for the 4 tiles
+			for (int o = 0; o < WINOGRAD_BLOCK * CONV2_CHANNELS; o++)
+				mp[o] = 0;
+			for (int i = 0; i < CONV1_CHANNELS; i++)
+			{
+				float x0 = vp[i], x1 = vp[CONV1_CHANNELS + i];
+				float x2 = vp[2 * CONV1_CHANNELS + i], x3 = vp[3 * CONV1_CHANNELS + i];
+				const float* w = up + i * CONV2_CHANNELS;
+				for (int o = 0; o < CONV2_CHANNELS; o++)
+				{
+					mp[o] += x0 * w[o];
+					mp[CONV2_CHANNELS + o] += x1 * w[o];
+					mp[2 * CONV2_CHANNELS + o] += x2 * w[o];
+					mp[3 * CONV2_CHANNELS + o] += x3 * w[o];
+				}
+			}
+#endif
+		}
+
+		// Output transforms: every 2 x 2 output tile is exactly one max pooling window
+		for (int t = 0; t < WINOGRAD_BLOCK; t++)
+		{
+			float* out = features + (tx0 + t) * CONV2_CHANNELS;
+#ifdef __AVX2__
+			for (int o = 0; o < CONV2_CHANNELS; o += 8)
+			{
+				__m256 y[4];
+				transformOutput8(m + t * CONV2_CHANNELS + o, WINOGRAD_BLOCK * CONV2_CHANNELS, y);
+				__m256 pooled = _mm256_max_ps(_mm256_max_ps(y[0], y[1]), _mm256_max_ps(y[2], y[3]));
+				_mm256_storeu_ps(out + o, _mm256_max_ps(_mm256_setzero_ps(), _mm256_add_ps(pooled, _mm256_loadu_ps(m_weights.conv2Bias + o))));
+			}
+#else
+			for (int o = 0; o < CONV2_CHANNELS; o++)
+			{
+				float y[4];
+				transformOutput(m + t * CONV2_CHANNELS + o, WINOGRAD_BLOCK * CONV2_CHANNELS, y);
+				float pooled = std::max(std::max(y[0], y[1]), std::max(y[2], y[3]));
+				out[o] = std::max(0.0f, pooled + m_weights.conv2Bias[o]);
+			}
+#endif
+		}
+	}
+}
+
+void DigitCnn::transformInput(const float* d, int rowStride, int colStride, float* v, int pointStride)
+{
+	// B^T d: combinations of the rows
+	float t[4][4];
+	for (int c = 0; c < 4; c++)
+	{
+		float d0 = d[c * colStride], d1 = d[rowStride + c * colStride];
+		float d2 = d[2 * rowStride + c * colStride], d3 = d[3 * rowStride + c * colStride];
+		t[0][c] = d0 - d2;
+		t[1][c] = d1 + d2;
+		t[2][c] = d2 - d1;
+		t[3][c] = d1 - d3;
+	}
+
+	// (B^T d) B: combinations of the columns
+	for (int r = 0; r < 4; r++)
+	{
+		v[(r * 4 + 0) * pointStride] = t[r][0] - t[r][2];
+		v[(r * 4 + 1) * pointStride] = t[r][1] + t[r][2];
+		v[(r * 4 + 2) * pointStride] = t[r][2] - t[r][1];
+		v[(r * 4 + 3) * pointStride] = t[r][1] - t[r][3];
+	}
+}
+
+void DigitCnn::transformOutput(const float* m, int pointStride, float y[4])
+{
+	// A^T m A, 4 x 4 to the 2 x 2 outputs
+	float s[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		float m0 = m[c * pointStride], m1 = m[(4 + c) * pointStride];
+		float m2 = m[(8 + c) * pointStride], m3 = m[(12 + c) * pointStride];
+		s[0][c] = m0 + m1 + m2;
+		s[1][c] = m1 - m2 - m3;
+	}
+	for (int r = 0; r < 2; r++)
+	{
+		y[r * 2 + 0] = s[r][0] + s[r][1] + s[r][2];
+		y[r * 2 + 1] = s[r][1] - s[r][2] - s[r][3];
+	}
+}
+
+void DigitCnn::classify(const float* const* features, int count, int* digits, float* confidences) const
+{
+	float hidden[DENSE_BLOCK][HIDDEN];
+	for (int t = 0; t < count; t++)
+		for (int h = 0; h < HIDDEN; h++)
+			hidden[t][h] = m_weights.dense1Bias[h];
+
+	// Dense 1: every row of the 4.5 MB kernel is read once for the whole block
+	for (int k = 0; k < FEATURES; k++)
+	{
+		const float* w = m_weights.dense1Kernel + (size_t)k * HIDDEN;
+		for (int t = 0; t < count; t++)
+		{
+			float v = features[t][k];
+			if (v == 0)
+				continue;
+			for (int h = 0; h < HIDDEN; h++)
+				hidden[t][h] += v * w[h];
+		}
+	}
+
+	// ReLU, dense 2 and softmax
+	for (int t = 0; t < count; t++)
+		classifyHidden(hidden[t], digits[t], confidences[t]);
+}
+
+void DigitCnn::computeQuantizedFeatures(const unsigned char* tile, unsigned char* conv1, unsigned char* conv2, unsigned char* features) const
+{
+	// Conv 1 in float (9 taps of a binary input) + ReLU, to 7-bit activations
+	const float toSteps = 1.0f / m_quantized.conv1Scale;
+	for (int y = 0; y < CONV1_SIZE; y++)
+	{
+		for (int x = 0; x < CONV1_SIZE; x++)
+		{
+			float acc[CONV1_CHANNELS];
+			for (int o = 0; o < CONV1_CHANNELS; o++)
+				acc[o] = m_weights.conv1Bias[o];
+
+			for (int ky = 0; ky < KERNEL; ky++)
+			{
+				for (int kx = 0; kx < KERNEL; kx++)
+				{
+					if (tile[(y + ky) * CELL_SIZE + x + kx] > INPUT_THRESHOLD)
+						continue;
+					const float* w = m_weights.conv1Kernel + (ky * KERNEL + kx) * CONV1_CHANNELS;
+					for (int o = 0; o < CONV1_CHANNELS; o++)
+						acc[o] += w[o];
+				}
+			}
+
+			unsigned char* out = conv1 + (y * CONV1_SIZE + x) * CONV1_CHANNELS;
+			for (int o = 0; o < CONV1_CHANNELS; o++)
+				out[o] = toActivation(acc[o] * toSteps);
+		}
+	}
+
+	// Conv 2 + ReLU on the int8 weights. The 4 weights of a group are the same (ky, kx)
+	// and 4 consecutive input channels, which are 4 consecutive bytes of conv1
+	const signed char* kernel = m_quantized.conv2Kernel;
+	const float* multiplier = m_quantized.conv2Multiplier;
+	const float* offset = m_quantized.conv2Offset;
+#ifdef __AVX2__
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxActivation = _mm256_set1_ps((float)MAX_ACTIVATION);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	for (int y = 0; y < CONV2_SIZE; y++)
+	{
+		for (int x = 0; x < CONV2_SIZE; x += BLOCK_ROWS)
+		{
+			for (int ob = 0; ob < CONV2_CHANNELS; ob += BLOCK_OUTPUTS)
+			{
+				__m256i acc[BLOCK_ROWS][2];
+				__m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+				__m256i b0 = a0, b1 = a0, b2 = a0, b3 = a0;
+
+				for (int ky = 0; ky < KERNEL; ky++)
+				{
+					for (int kx = 0; kx < KERNEL; kx++)
+					{
+						const unsigned char* in = conv1 + ((y + ky) * CONV1_SIZE + x + kx) * CONV1_CHANNELS;
+						const signed char* w = kernel + ((ky * KERNEL + kx) * (CONV1_CHANNELS / GROUP) * CONV2_CHANNELS + ob) * GROUP;
+						for (int c = 0; c < CONV1_CHANNELS; c += GROUP, w += CONV2_CHANNELS * GROUP)
+						{
+							__m256i w0 = _mm256_loadu_si256((const __m256i*)w);
+							__m256i w1 = _mm256_loadu_si256((const __m256i*)(w + 8 * GROUP));
+							__m256i v = broadcastGroup(in + c);
+							a0 = dotAccumulate(a0, v, w0);
+							b0 = dotAccumulate(b0, v, w1);
+							v = broadcastGroup(in + CONV1_CHANNELS + c);
+							a1 = dotAccumulate(a1, v, w0);
+							b1 = dotAccumulate(b1, v, w1);
+							v = broadcastGroup(in + 2 * CONV1_CHANNELS + c);
+							a2 = dotAccumulate(a2, v, w0);
+							b2 = dotAccumulate(b2, v, w1);
+							v = broadcastGroup(in + 3 * CONV1_CHANNELS + c);
+							a3 = dotAccumulate(a3, v, w0);
+							b3 = dotAccumulate(b3, v, w1);
+						}
+					}
+				}
+				acc[0][0] = a0; acc[0][1] = b0;
+				acc[1][0] = a1; acc[1][1] = b1;
+				acc[2][0] = a2; acc[2][1] = b2;
+				acc[3][0] = a3; acc[3][1] = b3;
+
+				// Requantize: accumulator * multiplier + offset, clamped to 0 ... 127 and rounded
+				for (int p = 0; p < BLOCK_ROWS; p++)
+				{
+					unsigned char* out = conv2 + (y * CONV2_SIZE + x + p) * CONV2_CHANNELS + ob;
+					for (int part = 0; part < 2; part++)
+					{
+						__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[p][part]), _mm256_loadu_ps(multiplier + ob + 8 * part)),
+							_mm256_loadu_ps(offset + ob + 8 * part));
+						value = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(value, zero), maxActivation), half);
+						int steps[8];
+						_mm256_storeu_si256((__m256i*)steps, _mm256_cvttps_epi32(value));
+						for (int o = 0; o < 8; o++)
+							out[8 * part + o] = (unsigned char)steps[o];
+					}
+				}
+			}
+		}
+	}
+#else
+	for (int y = 0; y < CONV2_SIZE; y++)
+	{
+		for (int x = 0; x < CONV2_SIZE; x++)
+		{
+			int acc[CONV2_CHANNELS] = { 0 };
+			for (int g = 0; g < CONV2_GROUPS; g++)
+			{
+				int tap = g / (CONV1_CHANNELS / GROUP);
+				const unsigned char* in = conv1 + ((y + tap / KERNEL) * CONV1_SIZE + x + tap % KERNEL) * CONV1_CHANNELS
+					+ (g % (CONV1_CHANNELS / GROUP)) * GROUP;
+				const signed char* w = kernel + (size_t)g * CONV2_CHANNELS * GROUP;
+				for (int o = 0; o < CONV2_CHANNELS; o++, w += GROUP)
+					acc[o] += in[0] * w[0] + in[1] * w[1] + in[2] * w[2] + in[3] * w[3];
+			}
+
+			unsigned char* out = conv2 + (y * CONV2_SIZE + x) * CONV2_CHANNELS;
+			for (int o = 0; o < CONV2_CHANNELS; o++)
+				out[o] = toActivation(acc[o] * multiplier[o] + offset[o]);
+		}
+	}
+#endif
+
+	// Max pooling 2 x 2, on the 7-bit values (the requantization keeps the order)
+	for (int y = 0; y < POOL_SIZE; y++)
+	{
+		for (int x = 0; x < POOL_SIZE; x++)
+		{
+			const unsigned char* a = conv2 + ((2 * y) * CONV2_SIZE + 2 * x) * CONV2_CHANNELS;
+			const unsigned char* b = a + CONV2_CHANNELS;
+			const unsigned char* c = a + CONV2_SIZE * CONV2_CHANNELS;
+			const unsigned char* d = c + CONV2_CHANNELS;
+			unsigned char* out = features + (y * POOL_SIZE + x) * CONV2_CHANNELS;
+			for (int o = 0; o < CONV2_CHANNELS; o++)
+				out[o] = std::max(std::max(a[o], b[o]), std::max(c[o], d[o]));
+		}
+	}
+}
+
+void DigitCnn::classifyQuantized(const unsigned char* const* features, int count, int* digits, float* confidences) const
+{
+	float hidden[DENSE_BLOCK][HIDDEN];
+	const float* multiplier = m_quantized.dense1Multiplier;
+	const float* bias = m_weights.dense1Bias;
+
+	// Dense 1 on the int8 weights, 4 tiles at a time
+#ifdef __AVX2__
+	for (int t0 = 0; t0 < count; t0 += BLOCK_ROWS)
+	{
+		// The missing tiles of the last 4 repeat the first one, their results are dropped
+		const unsigned char* rows[BLOCK_ROWS];
+		for (int p = 0; p < BLOCK_ROWS; p++)
+			rows[p] = features[std::min(t0 + p, count - 1)];
+
+		for (int ob = 0; ob < HIDDEN; ob += BLOCK_OUTPUTS)
+		{
+			__m256i acc[BLOCK_ROWS][2];
+			__m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+			__m256i b0 = a0, b1 = a0, b2 = a0, b3 = a0;
+
+			const signed char* w = m_quantized.dense1Kernel + ob * GROUP;
+			for (int g = 0; g < DENSE1_GROUPS; g++, w += HIDDEN * GROUP)
+			{
+				__m256i w0 = _mm256_loadu_si256((const __m256i*)w);
+				__m256i w1 = _mm256_loadu_si256((const __m256i*)(w + 8 * GROUP));
+				__m256i v = broadcastGroup(rows[0] + g * GROUP);
+				a0 = dotAccumulate(a0, v, w0);
+				b0 = dotAccumulate(b0, v, w1);
+				v = broadcastGroup(rows[1] + g * GROUP);
+				a1 = dotAccumulate(a1, v, w0);
+				b1 = dotAccumulate(b1, v, w1);
+				v = broadcastGroup(rows[2] + g * GROUP);
+				a2 = dotAccumulate(a2, v, w0);
+				b2 = dotAccumulate(b2, v, w1);
+				v = broadcastGroup(rows[3] + g * GROUP);
+				a3 = dotAccumulate(a3, v, w0);
+				b3 = dotAccumulate(b3, v, w1);
+			}
+			acc[0][0] = a0; acc[0][1] = b0;
+			acc[1][0] = a1; acc[1][1] = b1;
+			acc[2][0] = a2; acc[2][1] = b2;
+			acc[3][0] = a3; acc[3][1] = b3;
+
+			for (int p = 0; p < BLOCK_ROWS && t0 + p < count; p++)
+			{
+				for (int part = 0; part < 2; part++)
+				{
+					int o = ob + 8 * part;
+					__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[p][part]), _mm256_loadu_ps(multiplier + o)),
+						_mm256_loadu_ps(bias + o));
+					_mm256_storeu_ps(&hidden[t0 + p][o], value);
+				}
+			}
+		}
+	}
+#else
+	for (int t = 0; t < count; t++)
+	{
+		int acc[HIDDEN] = { 0 };
+		for (int g = 0; g < DENSE1_GROUPS; g++)
+		{
+			const unsigned char* in = features[t] + g * GROUP;
+			const signed char* w = m_quantized.dense1Kernel + (size_t)g * HIDDEN * GROUP;
+			for (int h = 0; h < HIDDEN; h++, w += GROUP)
+				acc[h] += in[0] * w[0] + in[1] * w[1] + in[2] * w[2] + in[3] * w[3];
+		}
+		for (int h = 0; h < HIDDEN; h++)
+			hidden[t][h] = acc[h] * multiplier[h] + bias[h];
+	}
+#endif
+
+	// ReLU, dense 2 and softmax
+	for (int t = 0; t < count; t++)
+		classifyHidden(hidden[t], digits[t], confidences[t]);
+}
+
+void DigitCnn::classifyHidden(const float* hidden, int& digit, float& confidence) const
+{
+	float logits[DIGIT_CLASSES];
+	for (int c = 0; c < DIGIT_CLASSES; c++)
+		logits[c] = m_weights.dense2Bias[c];
+
+	for (int h = 0; h < HIDDEN; h++)
+	{
+		float v = std::max(0.0f, hidden[h]);
+		const float* w = m_weights.dense2Kernel + h * DIGIT_CLASSES;
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			logits[c] += v * w[c];
+	}
+
+	int best = (int)(std::max_element(logits, logits + DIGIT_CLASSES) - logits);
+	float sum = 0;
+	for (int c = 0; c < DIGIT_CLASSES; c++)
+		sum += expf(logits[c] - logits[best]);
+
+	digit = best;
+	confidence = 1.0f / sum;
+}
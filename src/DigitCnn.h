@@ -0,0 +1,130 @@
+/**
+	DigitCnn.h
+	Purpose:	* Runs the digit network of scripts/training_cnn.py in process:
+				Conv3x3-32, Conv3x3-64, MaxPool2, Dense128, Dense10 (softmax),
+				all with ReLU, on the 28 x 28 tiles of the CellTensor.
+				* Replaces the round trip through python, Keras and the PNGs in
+				scripts/gray_imgs: the tiles are classified where they are, all
+				the cells of a grid in one batch.
+				* The weights are those of Keras, in its layouts (channels_last),
+				exported by scripts/export_cnn.py into a ModelFile. They are used
+				right where the file is mapped, never copied.
+				* The float path runs both convolutions as Winograd F(2x2, 3x3),
+				fused with the ReLUs and the max pooling, row of tiles by row of
+				tiles, so the intermediate maps of a tile stay in L1.
+				* Model files from scripts/quantize_cnn.py run conv 2 and dense 1,
+				almost all of the work, on int8 weights and 7-bit activations
+				(AVX2 maddubs, or VNNI when the target has it).
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef DigitCnn_H_
+#define DigitCnn_H_
+
+#include "CellExtractor.h"
+#include "DigitClassifier.h"
+#include "ModelFile.h"
+
+#include <string>
+#include <vector>
+
+#define DIGIT_CLASSES 10
+
+// Views of the weights of the network, in the order and layouts of Keras' get_weights()
+typedef struct
+{
+	const float* conv1Kernel;	// 3 x 3 x 1 x 32 (HWIO)
+	const float* conv1Bias;		// 32
+	const float* conv2Kernel;	// 3 x 3 x 32 x 64 (HWIO)
+	const float* conv2Bias;		// 64
+	const float* dense1Kernel;	// 9216 x 128, the inputs are the pooled 12 x 12 x 64 features (HWC)
+	const float* dense1Bias;	// 128
+	const float* dense2Kernel;	// 128 x 10
+	const float* dense2Bias;	// 10
+} DigitCnnWeights;
+
+// Int8 weights of conv 2 and dense 1, scaled per output channel. The activations are
+// unsigned 7-bit (0 ... 127), so the sums of two products in maddubs never saturate
+typedef struct
+{
+	float conv1Scale;					// real value of one step of the 7-bit conv 1 output
+	const signed char* conv2Kernel;		// 72 x 64 x 4: groups of 4 inputs (ky, kx, 4 channels) x outputs x the 4 weights
+	const float* conv2Multiplier;		// 64: accumulator to 7-bit conv 2 output steps
+	const float* conv2Offset;			// 64: bias, in 7-bit conv 2 output steps
+	const signed char* dense1Kernel;	// 2304 x 128 x 4, same packing
+	const float* dense1Multiplier;		// 128: accumulator to real value, before dense1Bias
+} DigitCnnQuantizedWeights;
+
+class DigitCnn : public DigitClassifier
+{
+public:
+	DigitCnn();
+
+	// Number of floats of all the weights
+	static size_t parameterCount();
+
+	/**
+	* Maps the model file written by scripts/export_cnn.py or scripts/quantize_cnn.py and uses its weights
+	* @return false if the file can't be mapped or doesn't hold all the tensors of the network
+	*/
+	bool load(const std::string& path) override;
+
+	// Uses weights owned by the caller, which must outlive the network
+	void setWeights(const DigitCnnWeights& weights);
+
+	// Same for a quantized network: of 'weights' only conv 1, the dense 1 bias and dense 2 are used
+	void setQuantizedWeights(const DigitCnnWeights& weights, const DigitCnnQuantizedWeights& quantized);
+
+	bool isLoaded() const override { return m_isLoaded; }
+	bool isQuantized() const { return m_isQuantized; }
+
+	// Confidences are the softmax probabilities of the network
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override;
+
+	// Float weights given to load() or setWeights()
+	const DigitCnnWeights& weights() const { return m_weights; }
+
+private:
+	// Conv, ReLU, conv, ReLU and max pooling of one tile into its flattened features.
+	// Fused: conv 1 rows are made just before conv 2 reads them, conv 2 outputs are pooled
+	// as soon as they are made, so nothing but the small 'scratch' of the tile is written
+	void computeFeatures(const unsigned char* tile, float* scratch, float* features) const;
+
+	// Winograd F(2 x 2, 3 x 3) parts of computeFeatures: conv 1 + ReLU of a row of 2 x 2 tiles
+	// into the ring of rows, conv 2 + ReLU + max pooling of a row of tiles into the features
+	void computeConv1Row(const unsigned char* tile, int ty, float* ring) const;
+	void computeConv2Row(const float* ring, int ty, float* scratch, float* features) const;
+
+	// Transformed kernels U = G g G^T of both convolutions, point-major, made once by setWeights
+	void prepareWinograd();
+	static void transformKernel(const float* g, int stride, float u[16]);
+	static void transformInput(const float* d, int rowStride, int colStride, float* v, int pointStride);
+	static void transformOutput(const float* m, int pointStride, float y[4]);
+
+	// Both dense layers and the softmax of 'count' feature vectors
+	void classify(const float* const* features, int count, int* digits, float* confidences) const;
+
+	// Same as the two above on the int8 weights, with 7-bit activations
+	void computeQuantizedFeatures(const unsigned char* tile, unsigned char* conv1, unsigned char* conv2, unsigned char* features) const;
+	void classifyQuantized(const unsigned char* const* features, int count, int* digits, float* confidences) const;
+
+	// ReLU, dense 2 and softmax of the output of dense 1
+	void classifyHidden(const float* hidden, int& digit, float& confidence) const;
+
+	bool loadQuantized(const std::string& path);
+
+	bool m_isLoaded;
+	bool m_isQuantized;
+	DigitCnnWeights m_weights;
+	DigitCnnQuantizedWeights m_quantized;
+	ModelFile m_modelFile; // Mapping of the weights given to load()
+	std::vector<float> m_winograd; // U of conv 1 [16][32], then of conv 2 [16][32][64]
+
+	std::vector<float> m_features; // Flattened features of the tiles of the last batch
+	std::vector<unsigned char> m_quantizedFeatures;
+};
+
+#endif // !DigitCnn_H_
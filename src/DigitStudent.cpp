@@ -0,0 +1,230 @@
+/**
+	DigitStudent.cpp
+	Purpose:	* Implements the forward pass of the distilled student network.
+				Every layer is fused with its ReLU and the max pooling after it,
+				and only the outputs the pooling keeps are computed. The channel
+				loops have fixed lengths and run over contiguous weights, so the
+				compiler vectorizes them.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "DigitStudent.h"
+#include "CellExtractor.h"
+#include "DigitCnn.h"
+
+#include "opencv2/core.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+
+namespace
+{
+	// Must match scripts/distill_student.py
+	const int KERNEL = 3;
+
+	const int CONV1_SIZE = CELL_SIZE - KERNEL + 1;	// 26
+	const int CONV1_CHANNELS = 16;
+	const int POOL1_SIZE = CONV1_SIZE / 2;			// 13
+	const int SEP1_SIZE = POOL1_SIZE - KERNEL + 1;	// 11
+	const int SEP1_CHANNELS = 32;
+	const int POOL2_SIZE = SEP1_SIZE / 2;			// 5, the last row and column of sep 1 are dropped
+	const int SEP2_SIZE = POOL2_SIZE - KERNEL + 1;	// 3
+	const int SEP2_CHANNELS = 64;
+	const int FEATURES = SEP2_SIZE * SEP2_SIZE * SEP2_CHANNELS;
+
+	const size_t CONV1_WEIGHTS = KERNEL * KERNEL * CONV1_CHANNELS;
+	const size_t SEP1_DEPTHWISE = KERNEL * KERNEL * CONV1_CHANNELS;
+	const size_t SEP1_POINTWISE = CONV1_CHANNELS * SEP1_CHANNELS;
+	const size_t SEP2_DEPTHWISE = KERNEL * KERNEL * SEP1_CHANNELS;
+	const size_t SEP2_POINTWISE = SEP1_CHANNELS * SEP2_CHANNELS;
+	const size_t DENSE_WEIGHTS = (size_t)FEATURES * DIGIT_CLASSES;
+
+	// Depthwise 3 x 3 of the 'channels' channels of an HWC map at (y, x), then pointwise to 'outputs' channels + bias
+	template<int channels, int outputs>
+	inline void separableAt(const float* in, int width, int y, int x, const float* depthwise, const float* pointwise,
+		const float* bias, float* out)
+	{
+		float depth[channels] = {};
+		for (int ky = 0; ky < KERNEL; ky++)
+		{
+			for (int kx = 0; kx < KERNEL; kx++)
+			{
+				const float* pixel = in + ((size_t)(y + ky) * width + x + kx) * channels;
+				const float* w = depthwise + (ky * KERNEL + kx) * channels;
+				for (int c = 0; c < channels; c++)
+					depth[c] += pixel[c] * w[c];
+			}
+		}
+
+		// Accumulated locally, so that the sums stay in registers
+		float acc[outputs];
+		std::copy(bias, bias + outputs, acc);
+		for (int c = 0; c < channels; c++)
+		{
+			const float* w = pointwise + c * outputs;
+			for (int o = 0; o < outputs; o++)
+				acc[o] += depth[c] * w[o];
+		}
+		std::copy(acc, acc + outputs, out);
+	}
+}
+
+DigitStudent::DigitStudent() :
+	m_isLoaded(false)
+{
+}
+
+size_t DigitStudent::parameterCount()
+{
+	return CONV1_WEIGHTS + CONV1_CHANNELS + SEP1_DEPTHWISE + SEP1_POINTWISE + SEP1_CHANNELS
+		+ SEP2_DEPTHWISE + SEP2_POINTWISE + SEP2_CHANNELS + DENSE_WEIGHTS + DIGIT_CLASSES;
+}
+
+bool DigitStudent::load(const std::string& path)
+{
+	m_isLoaded = false;
+	if (!m_modelFile.open(path))
+		return false;
+
+	DigitStudentWeights weights;
+	weights.conv1Kernel = m_modelFile.floats("conv1.kernel", CONV1_WEIGHTS);
+	weights.conv1Bias = m_modelFile.floats("conv1.bias", CONV1_CHANNELS);
+	weights.sep1Depthwise = m_modelFile.floats("sep1.depthwise", SEP1_DEPTHWISE);
+	weights.sep1Pointwise = m_modelFile.floats("sep1.pointwise", SEP1_POINTWISE);
+	weights.sep1Bias = m_modelFile.floats("sep1.bias", SEP1_CHANNELS);
+	weights.sep2Depthwise = m_modelFile.floats("sep2.depthwise", SEP2_DEPTHWISE);
+	weights.sep2Pointwise = m_modelFile.floats("sep2.pointwise", SEP2_POINTWISE);
+	weights.sep2Bias = m_modelFile.floats("sep2.bias", SEP2_CHANNELS);
+	weights.denseKernel = m_modelFile.floats("dense.kernel", DENSE_WEIGHTS);
+	weights.denseBias = m_modelFile.floats("dense.bias", DIGIT_CLASSES);
+
+	if (!weights.conv1Kernel || !weights.conv1Bias || !weights.sep1Depthwise || !weights.sep1Pointwise || !weights.sep1Bias
+		|| !weights.sep2Depthwise || !weights.sep2Pointwise || !weights.sep2Bias || !weights.denseKernel || !weights.denseBias)
+	{
+		std::cout << path << " is not a student digit network" << std::endl;
+		m_modelFile.close();
+		return false;
+	}
+
+	setWeights(weights);
+	return true;
+}
+
+void DigitStudent::setWeights(const DigitStudentWeights& weights)
+{
+	m_weights = weights;
+	m_isLoaded = true;
+}
+
+void DigitStudent::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	for (int t = 0; t < count; t++)
+	{
+		digits[t] = -1;
+		if (confidences)
+			confidences[t] = 0;
+	}
+	if (!m_isLoaded)
+		return;
+
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+		for (int t = range.start; t < range.end; t++)
+		{
+			if (skip && skip[t])
+				continue;
+
+			float logits[DIGIT_CLASSES];
+			forward(tiles + (size_t)t * CELL_PIXELS, logits);
+
+			int digit = (int)(std::max_element(logits, logits + DIGIT_CLASSES) - logits);
+			digits[t] = digit;
+			if (confidences)
+			{
+				float sum = 0;
+				for (int c = 0; c < DIGIT_CLASSES; c++)
+					sum += expf(logits[c] - logits[digit]);
+				confidences[t] = 1.0f / sum;
+			}
+		}
+	});
+}
+
+void DigitStudent::forward(const unsigned char* tile, float logits[]) const
+{
+	const DigitStudentWeights& w = m_weights;
+
+	// Binary input, as floats so that conv 1 runs without branches
+	float input[CELL_PIXELS];
+	for (int i = 0; i < CELL_PIXELS; i++)
+		input[i] = tile[i] <= INPUT_THRESHOLD ? 1.0f : 0.0f;
+
+	// Conv 1 + ReLU + max pooling. The ReLU commutes with the max: pooled outputs start at 0
+	float pool1[POOL1_SIZE * POOL1_SIZE * CONV1_CHANNELS];
+	for (int py = 0; py < POOL1_SIZE; py++)
+	{
+		for (int px = 0; px < POOL1_SIZE; px++)
+		{
+			float* out = pool1 + (py * POOL1_SIZE + px) * CONV1_CHANNELS;
+			std::fill(out, out + CONV1_CHANNELS, 0.0f);
+			for (int p = 0; p < 4; p++)
+			{
+				int y = 2 * py + p / 2;
+				int x = 2 * px + p % 2;
+				float acc[CONV1_CHANNELS];
+				std::copy(w.conv1Bias, w.conv1Bias + CONV1_CHANNELS, acc);
+				for (int k = 0; k < KERNEL * KERNEL; k++)
+				{
+					float v = input[(y + k / KERNEL) * CELL_SIZE + x + k % KERNEL];
+					const float* kernel = w.conv1Kernel + k * CONV1_CHANNELS;
+					for (int c = 0; c < CONV1_CHANNELS; c++)
+						acc[c] += v * kernel[c];
+				}
+				for (int c = 0; c < CONV1_CHANNELS; c++)
+					out[c] = std::max(out[c], acc[c]);
+			}
+		}
+	}
+
+	// Separable conv 1 + ReLU + max pooling, only on the 10 x 10 outputs the pooling reads
+	float pool2[POOL2_SIZE * POOL2_SIZE * SEP1_CHANNELS];
+	for (int py = 0; py < POOL2_SIZE; py++)
+	{
+		for (int px = 0; px < POOL2_SIZE; px++)
+		{
+			float* out = pool2 + (py * POOL2_SIZE + px) * SEP1_CHANNELS;
+			std::fill(out, out + SEP1_CHANNELS, 0.0f);
+			for (int p = 0; p < 4; p++)
+			{
+				float acc[SEP1_CHANNELS];
+				separableAt<CONV1_CHANNELS, SEP1_CHANNELS>(pool1, POOL1_SIZE, 2 * py + p / 2, 2 * px + p % 2,
+					w.sep1Depthwise, w.sep1Pointwise, w.sep1Bias, acc);
+				for (int c = 0; c < SEP1_CHANNELS; c++)
+					out[c] = std::max(out[c], acc[c]);
+			}
+		}
+	}
+
+	// Separable conv 2 + ReLU, flattened HWC like Keras' Flatten
+	float features[FEATURES];
+	for (int y = 0; y < SEP2_SIZE; y++)
+	{
+		for (int x = 0; x < SEP2_SIZE; x++)
+		{
+			float* out = features + (y * SEP2_SIZE + x) * SEP2_CHANNELS;
+			separableAt<SEP1_CHANNELS, SEP2_CHANNELS>(pool2, POOL2_SIZE, y, x, w.sep2Depthwise, w.sep2Pointwise, w.sep2Bias, out);
+			for (int c = 0; c < SEP2_CHANNELS; c++)
+				out[c] = std::max(0.0f, out[c]);
+		}
+	}
+
+	std::copy(w.denseBias, w.denseBias + DIGIT_CLASSES, logits);
+	for (int f = 0; f < FEATURES; f++)
+	{
+		const float* kernel = w.denseKernel + f * DIGIT_CLASSES;
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			logits[c] += features[f] * kernel[c];
+	}
+}
@@ -0,0 +1,72 @@
+/**
+	DigitStudent.h
+	Purpose:	* Runs the small network that scripts/distill_student.py distills
+				from the combination network of DigitCnn, for low-power stations:
+				Conv3x3-16, MaxPool2, SeparableConv3x3-32, MaxPool2,
+				SeparableConv3x3-64, Dense10 (softmax), the convolutions with ReLU.
+				* About 9k parameters and 200k multiplications per tile, against
+				1.2M and 12M for DigitCnn. All the activations of a tile fit in
+				17 KB of stack.
+				* The weights are those of Keras (channels_last), exported into a
+				ModelFile, and used where the file is mapped.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef DigitStudent_H_
+#define DigitStudent_H_
+
+#include "DigitClassifier.h"
+#include "ModelFile.h"
+
+#include <string>
+
+// Views of the weights of the student, in the order and layouts of Keras' get_weights()
+typedef struct
+{
+	const float* conv1Kernel;		// 3 x 3 x 1 x 16 (HWIO)
+	const float* conv1Bias;			// 16
+	const float* sep1Depthwise;		// 3 x 3 x 16 x 1
+	const float* sep1Pointwise;		// 1 x 1 x 16 x 32
+	const float* sep1Bias;			// 32
+	const float* sep2Depthwise;		// 3 x 3 x 32 x 1
+	const float* sep2Pointwise;		// 1 x 1 x 32 x 64
+	const float* sep2Bias;			// 64
+	const float* denseKernel;		// 576 x 10, the inputs are the 3 x 3 x 64 outputs of sep 2 (HWC)
+	const float* denseBias;			// 10
+} DigitStudentWeights;
+
+class DigitStudent : public DigitClassifier
+{
+public:
+	DigitStudent();
+
+	// Number of floats of all the weights
+	static size_t parameterCount();
+
+	/**
+	* Maps the model file written by scripts/distill_student.py and uses its weights
+	* @return false if the file can't be mapped or doesn't hold all the tensors of the student
+	*/
+	bool load(const std::string& path) override;
+
+	// Uses weights owned by the caller, which must outlive the network
+	void setWeights(const DigitStudentWeights& weights);
+
+	bool isLoaded() const override { return m_isLoaded; }
+
+	// Confidences are the softmax probabilities of the network
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override;
+
+private:
+	// Logits of one tile
+	void forward(const unsigned char* tile, float logits[]) const;
+
+	bool m_isLoaded;
+	DigitStudentWeights m_weights;
+	ModelFile m_modelFile; // Mapping of the weights given to load()
+};
+
+#endif // !DigitStudent_H_
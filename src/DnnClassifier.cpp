@@ -0,0 +1,85 @@
+/**
+	DnnClassifier.cpp
+	Purpose:	* Implements the digit recognition through cv::dnn.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "DnnClassifier.h"
+#include "CellExtractor.h"
+
+#include <algorithm>
+#include <iostream>
+
+DnnClassifier::DnnClassifier() :
+	m_isLoaded(false)
+{
+}
+
+bool DnnClassifier::load(const std::string& path)
+{
+	m_isLoaded = false;
+
+#ifdef SUDOKU_AR_DNN
+	try
+	{
+		m_net = cv::dnn::readNet(path);
+	}
+	catch (const cv::Exception& e)
+	{
+		std::cout << "Could not read the network " << path << ": " << e.what() << std::endl;
+		return false;
+	}
+	if (m_net.empty())
+	{
+		std::cout << "Could not read the network " << path << std::endl;
+		return false;
+	}
+
+	m_isLoaded = true;
+#else
+	std::cout << "Built without cv::dnn (SUDOKU_AR_DNN), can't run " << path << std::endl;
+#endif
+	return m_isLoaded;
+}
+
+void DnnClassifier::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	std::vector<int> indices;
+	for (int t = 0; t < count; t++)
+	{
+		digits[t] = -1;
+		if (confidences)
+			confidences[t] = 0;
+		if (!skip || !skip[t])
+			indices.push_back(t);
+	}
+	if (!m_isLoaded || indices.empty())
+		return;
+
+#ifdef SUDOKU_AR_DNN
+	// N x 1 x 28 x 28, written in place: the tiles are already contiguous, only binarized
+	int shape[] = { (int)indices.size(), 1, CELL_SIZE, CELL_SIZE };
+	m_blob.create(4, shape, CV_32F);
+	float* input = m_blob.ptr<float>();
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const unsigned char* tile = tiles + (size_t)indices[i] * CELL_PIXELS;
+		for (int p = 0; p < CELL_PIXELS; p++)
+			*input++ = tile[p] > INPUT_THRESHOLD ? 0.0f : 1.0f;
+	}
+
+	m_net.setInput(m_blob);
+	cv::Mat probabilities = m_net.forward().reshape(1, (int)indices.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const float* row = probabilities.ptr<float>((int)i);
+		int digit = (int)(std::max_element(row, row + probabilities.cols) - row);
+		digits[indices[i]] = digit;
+		if (confidences)
+			confidences[indices[i]] = row[digit];
+	}
+#endif
+}
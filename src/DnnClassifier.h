@@ -0,0 +1,46 @@
+/**
+	DnnClassifier.h
+	Purpose:	* Runs an exported digit network with OpenCV's dnn module: an ONNX
+				file of scripts/export_onnx.py, or a frozen TensorFlow graph.
+				* The whole batch is one N x 1 x 28 x 28 blob of the binary tiles
+				(ink is 1), the same input as DigitCnn; the network must end
+				with its softmax.
+				* Built without SUDOKU_AR_DNN (OpenCV without dnn), load always fails.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef DnnClassifier_H_
+#define DnnClassifier_H_
+
+#include "DigitClassifier.h"
+
+#include "opencv2/core.hpp"
+#ifdef SUDOKU_AR_DNN
+#include "opencv2/dnn.hpp"
+#endif
+
+class DnnClassifier : public DigitClassifier
+{
+public:
+	DnnClassifier();
+
+	// Reads the .onnx or .pb network, by its extension
+	bool load(const std::string& path) override;
+
+	bool isLoaded() const override { return m_isLoaded; }
+
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override;
+
+private:
+	bool m_isLoaded;
+
+#ifdef SUDOKU_AR_DNN
+	cv::dnn::Net m_net;
+#endif
+	cv::Mat m_blob; // Input of the last batch, only the tiles that were not skipped
+};
+
+#endif // !DnnClassifier_H_
@@ -0,0 +1,104 @@
+/**
+	HogClassifier.cpp
+	Purpose:	* Implements the HOG features and the linear SVMs of the HOG classifier.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "HogClassifier.h"
+#include "CellExtractor.h"
+#include "DigitCnn.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+
+namespace
+{
+	// Must match scripts/train_hog.py
+	const int HOG_BLOCK = 14;
+	const int HOG_CELL = 7;
+	const int HOG_BINS = 9;
+}
+
+HogClassifier::HogClassifier() :
+	m_isLoaded(false)
+	, m_hog(cv::Size(CELL_SIZE, CELL_SIZE), cv::Size(HOG_BLOCK, HOG_BLOCK), cv::Size(HOG_CELL, HOG_CELL), cv::Size(HOG_CELL, HOG_CELL), HOG_BINS)
+	, m_weights(NULL)
+	, m_bias(NULL)
+{
+}
+
+int HogClassifier::featureCount()
+{
+	int blocks = (CELL_SIZE - HOG_BLOCK) / HOG_CELL + 1;
+	return blocks * blocks * (HOG_BLOCK / HOG_CELL) * (HOG_BLOCK / HOG_CELL) * HOG_BINS;
+}
+
+bool HogClassifier::load(const std::string& path)
+{
+	m_isLoaded = false;
+	if (!m_modelFile.open(path))
+		return false;
+
+	m_weights = m_modelFile.floats("hog.weights", (size_t)featureCount() * DIGIT_CLASSES);
+	m_bias = m_modelFile.floats("hog.bias", DIGIT_CLASSES);
+	if (!m_weights || !m_bias || (int)m_hog.getDescriptorSize() != featureCount())
+	{
+		std::cout << path << " is not a HOG digit model" << std::endl;
+		m_modelFile.close();
+		return false;
+	}
+
+	m_isLoaded = true;
+	return true;
+}
+
+void HogClassifier::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	for (int t = 0; t < count; t++)
+	{
+		digits[t] = -1;
+		if (confidences)
+			confidences[t] = 0;
+	}
+	if (!m_isLoaded)
+		return;
+
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+		cv::Mat binary(CELL_SIZE, CELL_SIZE, CV_8U);
+		std::vector<float> descriptor;
+		for (int t = range.start; t < range.end; t++)
+		{
+			if (skip && skip[t])
+				continue;
+
+			cv::Mat tile(CELL_SIZE, CELL_SIZE, CV_8U, (void*)(tiles + (size_t)t * CELL_PIXELS));
+			cv::threshold(tile, binary, INPUT_THRESHOLD, 255, cv::THRESH_BINARY_INV);
+			m_hog.compute(binary, descriptor);
+
+			// One linear SVM per class, the weights are features x classes
+			float scores[DIGIT_CLASSES];
+			std::copy(m_bias, m_bias + DIGIT_CLASSES, scores);
+			for (size_t f = 0; f < descriptor.size(); f++)
+			{
+				const float* w = m_weights + f * DIGIT_CLASSES;
+				for (int c = 0; c < DIGIT_CLASSES; c++)
+					scores[c] += descriptor[f] * w[c];
+			}
+
+			int digit = (int)(std::max_element(scores, scores + DIGIT_CLASSES) - scores);
+			digits[t] = digit;
+			if (confidences)
+			{
+				float sum = 0;
+				for (int c = 0; c < DIGIT_CLASSES; c++)
+					sum += expf(scores[c] - scores[digit]);
+				confidences[t] = 1.0f / sum;
+			}
+		}
+	});
+}
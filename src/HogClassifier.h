@@ -0,0 +1,45 @@
+/**
+	HogClassifier.h
+	Purpose:	* Cheap digit recognizer for clean printed grids: a HOG descriptor
+				of the binary tile (3 x 3 blocks of 2 x 2 cells of 7 pixels,
+				9 orientations: 324 features) and one linear SVM per class.
+				* The weights come from scripts/train_hog.py, in a ModelFile,
+				and are used where the file is mapped.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef HogClassifier_H_
+#define HogClassifier_H_
+
+#include "DigitClassifier.h"
+#include "ModelFile.h"
+
+#include "opencv2/objdetect.hpp"
+
+class HogClassifier : public DigitClassifier
+{
+public:
+	HogClassifier();
+
+	// Size of the descriptor of a tile, the rows of the weights
+	static int featureCount();
+
+	bool load(const std::string& path) override;
+
+	bool isLoaded() const override { return m_isLoaded; }
+
+	// Confidences are the softmax of the SVM scores, not calibrated probabilities
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override;
+
+private:
+	bool m_isLoaded;
+	cv::HOGDescriptor m_hog;
+	ModelFile m_modelFile;
+	const float* m_weights;	// featureCount() x 10
+	const float* m_bias;	// 10
+};
+
+#endif // !HogClassifier_H_
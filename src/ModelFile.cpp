@@ -0,0 +1,204 @@
+/**
+	ModelFile.cpp
+	Purpose:	* Implements the memory mapping of the model files, with mmap
+				on POSIX systems and file mappings on Windows.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "ModelFile.h"
+
+#include <iostream>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ModelFile::ModelFile() :
+	m_data(NULL)
+	, m_size(0)
+	, m_header(NULL)
+	, m_entries(NULL)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(NULL)
+#endif
+{
+}
+
+ModelFile::~ModelFile()
+{
+	close();
+}
+
+bool ModelFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Could not open the model file " << path << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_file, &size);
+	m_size = (size_t)size.QuadPart;
+
+	m_mapping = m_size > 0 ? CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	void* data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (data == NULL)
+	{
+		std::cout << "Could not map the model file " << path << std::endl;
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cout << "Could not open the model file " << path << std::endl;
+		return false;
+	}
+
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &status) == 0 && status.st_size > 0)
+	{
+		m_size = (size_t)status.st_size;
+		data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd); // The mapping keeps the file
+
+	if (data == MAP_FAILED)
+	{
+		std::cout << "Could not map the model file " << path << std::endl;
+		m_size = 0;
+		return false;
+	}
+
+	// The weights are all read by the first prediction: start paging them in now
+	madvise(data, m_size, MADV_WILLNEED);
+#endif
+
+	m_data = (const unsigned char*)data;
+	m_header = (const ModelFileHeader*)m_data;
+	m_entries = (const ModelTensorEntry*)(m_data + sizeof(ModelFileHeader));
+
+	if (!validate(path))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ModelFile::close()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		munmap((void*)m_data, m_size);
+#endif
+
+	m_data = NULL;
+	m_size = 0;
+	m_header = NULL;
+	m_entries = NULL;
+}
+
+bool ModelFile::validate(const std::string& path) const
+{
+	if (m_size < sizeof(ModelFileHeader) || memcmp(m_header->magic, MODEL_FILE_MAGIC, sizeof(m_header->magic)) != 0)
+	{
+		std::cout << path << " is not a model file" << std::endl;
+		return false;
+	}
+	if (m_header->version != MODEL_FILE_VERSION)
+	{
+		std::cout << path << " has version " << m_header->version << ", expected " << MODEL_FILE_VERSION
+			<< ". Convert it again with scripts/export_cnn.py" << std::endl;
+		return false;
+	}
+	if (m_header->fileSize != m_size
+		|| (m_size - sizeof(ModelFileHeader)) / sizeof(ModelTensorEntry) < m_header->tensorCount)
+	{
+		std::cout << path << " is truncated" << std::endl;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < m_header->tensorCount; i++)
+	{
+		const ModelTensorEntry& entry = m_entries[i];
+		if (entry.offset % MODEL_FILE_ALIGN != 0 || entry.offset > m_size || entry.bytes > m_size - entry.offset
+			|| memchr(entry.name, 0, MODEL_TENSOR_NAME_SIZE) == NULL)
+		{
+			std::cout << path << ": tensor " << i << " is corrupt" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t ModelFile::typeSize(uint32_t type)
+{
+	switch (type)
+	{
+	case MODEL_FLOAT32:
+		return sizeof(float);
+	case MODEL_INT8:
+		return sizeof(signed char);
+	default:
+		return 0;
+	}
+}
+
+bool ModelFile::hasTensor(const std::string& name) const
+{
+	for (uint32_t i = 0; isOpen() && i < m_header->tensorCount; i++)
+	{
+		if (name == m_entries[i].name)
+			return true;
+	}
+	return false;
+}
+
+const void* ModelFile::tensor(const std::string& name, ModelDataType type, size_t count) const
+{
+	if (!isOpen())
+		return NULL;
+
+	for (uint32_t i = 0; i < m_header->tensorCount; i++)
+	{
+		const ModelTensorEntry& entry = m_entries[i];
+		if (name != entry.name)
+			continue;
+
+		if (entry.type != (uint32_t)type || entry.bytes != count * typeSize(type))
+		{
+			std::cout << "Tensor " << name << " has the wrong type or size" << std::endl;
+			return NULL;
+		}
+		return m_data + entry.offset;
+	}
+
+	std::cout << "No tensor " << name << " in the model file" << std::endl;
+	return NULL;
+}
@@ -0,0 +1,110 @@
+/**
+	ModelFile.h
+	Purpose:	* Reads the weight files written by scripts/export_cnn.py by
+				mapping them into memory: opening one costs a few system calls
+				and no copy, every process that maps the same file shares one
+				copy of it in the page cache.
+				* Layout (little endian), every part starting on a 64 byte boundary:
+					ModelFileHeader
+					ModelTensorEntry x tensorCount
+					the data of every tensor, at its offset
+				* The views handed out stay valid until the file is closed.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef ModelFile_H_
+#define ModelFile_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define MODEL_FILE_MAGIC "SUDOKUNN"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_ALIGN 64
+#define MODEL_TENSOR_NAME_SIZE 24
+#define MODEL_TENSOR_MAX_RANK 4
+
+enum ModelDataType
+{
+	MODEL_FLOAT32 = 0,
+	MODEL_INT8			// quantized weights (scripts/quantize_cnn.py)
+};
+
+typedef struct
+{
+	char magic[8];				// MODEL_FILE_MAGIC, not 0-terminated
+	uint32_t version;			// MODEL_FILE_VERSION
+	uint32_t tensorCount;
+	uint64_t fileSize;			// of the whole file, to catch truncated copies
+	uint8_t reserved[40];
+} ModelFileHeader;
+
+typedef struct
+{
+	char name[MODEL_TENSOR_NAME_SIZE];		// 0-terminated, e.g. "conv1.kernel"
+	uint32_t type;							// ModelDataType
+	uint32_t rank;
+	uint32_t shape[MODEL_TENSOR_MAX_RANK];	// unused dimensions are 1
+	uint64_t offset;						// from the start of the file, multiple of MODEL_FILE_ALIGN
+	uint64_t bytes;
+} ModelTensorEntry;
+
+class ModelFile
+{
+public:
+	ModelFile();
+	~ModelFile();
+
+	/**
+	* Maps 'path' read-only and checks its header and table of tensors
+	* @return false (and a message) if it can't be mapped or isn't a valid model file
+	*/
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return m_data != NULL; }
+
+	/**
+	* Finds a tensor by name
+	* @param count number of elements it must have
+	* @return view of its data, NULL if there is no such tensor of that type and size
+	*/
+	const void* tensor(const std::string& name, ModelDataType type, size_t count) const;
+
+	const float* floats(const std::string& name, size_t count) const
+	{
+		return (const float*)tensor(name, MODEL_FLOAT32, count);
+	}
+
+	const signed char* int8s(const std::string& name, size_t count) const
+	{
+		return (const signed char*)tensor(name, MODEL_INT8, count);
+	}
+
+	// Whether the file has a tensor 'name', of any type and size
+	bool hasTensor(const std::string& name) const;
+
+private:
+	// The views point into the mapping, which must exist once
+	ModelFile(const ModelFile&);
+	ModelFile& operator=(const ModelFile&);
+
+	bool validate(const std::string& path) const;
+	static size_t typeSize(uint32_t type);
+
+	const unsigned char* m_data;
+	size_t m_size;
+	const ModelFileHeader* m_header;
+	const ModelTensorEntry* m_entries;
+
+#ifdef _WIN32
+	void* m_file;		// HANDLE
+	void* m_mapping;	// HANDLE
+#endif
+};
+
+#endif // !ModelFile_H_
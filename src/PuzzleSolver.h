@@ -151,20 +151,12 @@ namespace PuzzleSolver {
 		int input_as_row[NN];
 		matrix2array(input_grid, input_as_row);
 
-		std::cout << std::endl; printGrid(input_grid);
-
-		std::cout << "\nUnsolved in Row Major:" << std::endl; print1D(input_as_row); std::cout << "\n\n-----\n";
-
 		if (SolveSudoku(input_grid))
 		{
 			// solved Sudoku
-			printGrid(input_grid);
-
 			int solved_as_row[NN];
 			matrix2array(input_grid, solved_as_row);
 
-			std::cout << "\nSolved in Row Major:" << std::endl; print1D(solved_as_row); std::cout << "\n\n-----\n";
-
 			//int difference_row[NN];
 
 			set_difference(input_as_row, solved_as_row, difference_row);
@@ -174,7 +166,7 @@ namespace PuzzleSolver {
 			return true;
 		}
 
-		std::cout << "No solution exists" << std::endl;
+		// No solution exists
 		return false;
 	}
 }
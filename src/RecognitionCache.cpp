@@ -0,0 +1,161 @@
+/**
+	RecognitionCache.cpp
+	Purpose:	* Implements the tile hashes and the votes of the recognition cache.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "RecognitionCache.h"
+#include "CellExtractor.h"
+
+#include <algorithm>
+
+namespace
+{
+	const int HASH_BLOCK = 4;
+	const int HASH_BLOCKS = CELL_SIZE / HASH_BLOCK; // 7 x 7 bits
+
+	const int MAX_DIGIT = 9;
+
+	int hammingDistance(uint64_t a, uint64_t b)
+	{
+		uint64_t x = a ^ b;
+		int bits = 0;
+		for (; x; bits++)
+			x &= x - 1;
+		return bits;
+	}
+}
+
+RecognitionCache::RecognitionCache(int cellCount, int historySize, int sameDistance, int newContentDistance) :
+	m_historySize(historySize)
+	, m_sameDistance(sameDistance)
+	, m_newContentDistance(newContentDistance)
+	, m_cells(cellCount)
+{
+	clear();
+}
+
+uint64_t RecognitionCache::hashTile(const unsigned char* tile)
+{
+	int sums[HASH_BLOCKS * HASH_BLOCKS] = {};
+	int total = 0;
+	for (int y = 0; y < CELL_SIZE; y++)
+	{
+		const unsigned char* row = tile + y * CELL_SIZE;
+		int* blockRow = sums + (y / HASH_BLOCK) * HASH_BLOCKS;
+		for (int x = 0; x < CELL_SIZE; x++)
+			blockRow[x / HASH_BLOCK] += row[x];
+	}
+	for (int b = 0; b < HASH_BLOCKS * HASH_BLOCKS; b++)
+		total += sums[b];
+
+	// Bit b: block b is lighter than the whole tile
+	uint64_t hash = 0;
+	for (int b = 0; b < HASH_BLOCKS * HASH_BLOCKS; b++)
+	{
+		if (sums[b] * HASH_BLOCKS * HASH_BLOCKS > total)
+			hash |= (uint64_t)1 << b;
+	}
+	return hash;
+}
+
+void RecognitionCache::clear()
+{
+	for (size_t i = 0; i < m_cells.size(); i++)
+	{
+		Cell& cell = m_cells[i];
+		cell.hasHash = false;
+		cell.hash = cell.pendingHash = 0;
+		cell.votes.assign(m_historySize, -1);
+		cell.nextVote = 0;
+		cell.digit = -1;
+		cell.isSettled = false;
+	}
+}
+
+int RecognitionCache::lookup(const unsigned char* tiles, const bool* blank, bool* toClassify)
+{
+	int count = 0;
+	for (size_t i = 0; i < m_cells.size(); i++)
+	{
+		toClassify[i] = false;
+		if (blank[i])
+			continue;
+
+		Cell& cell = m_cells[i];
+		cell.pendingHash = hashTile(tiles + i * CELL_PIXELS);
+		toClassify[i] = !cell.hasHash || !cell.isSettled || hammingDistance(cell.pendingHash, cell.hash) > m_sameDistance;
+		if (toClassify[i])
+			count++;
+	}
+	return count;
+}
+
+bool RecognitionCache::vote(const bool* blank, const bool* classified, const int* digits)
+{
+	bool isChanged = false;
+	for (size_t i = 0; i < m_cells.size(); i++)
+	{
+		if (blank[i] || !classified[i] || digits[i] < 0 || digits[i] > MAX_DIGIT)
+			continue;
+
+		Cell& cell = m_cells[i];
+		if (cell.hasHash && hammingDistance(cell.pendingHash, cell.hash) >= m_newContentDistance)
+		{
+			// Another digit was written or the page changed: the old votes are about something else
+			std::fill(cell.votes.begin(), cell.votes.end(), -1);
+			cell.nextVote = 0;
+		}
+		cell.hash = cell.pendingHash;
+		cell.hasHash = true;
+
+		cell.votes[cell.nextVote] = digits[i];
+		cell.nextVote = (cell.nextVote + 1) % m_historySize;
+
+		int before = cell.digit;
+		bool wasSettled = cell.isSettled;
+		updateMajority(cell);
+		isChanged |= cell.digit != before || cell.isSettled != wasSettled;
+	}
+	return isChanged;
+}
+
+void RecognitionCache::updateMajority(Cell& cell)
+{
+	int counts[MAX_DIGIT + 1] = {};
+	int total = 0;
+	for (size_t v = 0; v < cell.votes.size(); v++)
+	{
+		if (cell.votes[v] >= 0)
+		{
+			counts[cell.votes[v]]++;
+			total++;
+		}
+	}
+
+	int best = (int)(std::max_element(counts, counts + MAX_DIGIT + 1) - counts);
+	cell.digit = counts[best] * 2 > total ? best : -1;
+
+	// Settled when even the runner-up taking all the empty places of the ring would not catch up
+	int runnerUp = 0;
+	for (int d = 0; d <= MAX_DIGIT; d++)
+	{
+		if (d != best)
+			runnerUp = std::max(runnerUp, counts[d]);
+	}
+	cell.isSettled = cell.digit >= 0 && counts[best] > runnerUp + (m_historySize - total);
+}
+
+bool RecognitionCache::votedDigits(const bool* blank, int* digits) const
+{
+	bool isComplete = true;
+	for (size_t i = 0; i < m_cells.size(); i++)
+	{
+		digits[i] = blank[i] ? 0 : (m_cells[i].isSettled ? m_cells[i].digit : -1);
+		if (digits[i] < 0)
+			isComplete = false;
+	}
+	return isComplete;
+}
@@ -0,0 +1,84 @@
+/**
+	RecognitionCache.h
+	Purpose:	* Remembers what every cell of the grid was recognized as, so that
+				the OCR can run on every good frame: a cell is classified on every
+				frame until its majority is settled, and after that only when its
+				tile looks different, by a perceptual hash of the 28 x 28 tile
+				(the mean of 4 x 4 blocks against the mean of the tile, 49 bits).
+				* Every classification is a vote; the digit of a cell is the
+				majority of its last votes, which keeps one misread frame out of
+				the grid given to the PuzzleSolver. The majority is settled once
+				the missing votes could not overturn it any more.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef RecognitionCache_H_
+#define RecognitionCache_H_
+
+#include <stdint.h>
+#include <vector>
+
+class RecognitionCache
+{
+public:
+	/**
+	* @param cellCount cells of the grid
+	* @param historySize votes kept per cell
+	* @param sameDistance largest Hamming distance of two hashes of the same tile
+	* @param newContentDistance smallest distance at which the cell holds something else, its votes are dropped
+	*/
+	RecognitionCache(int cellCount, int historySize, int sameDistance, int newContentDistance);
+
+	// Perceptual hash of a CELL_SIZE x CELL_SIZE tile
+	static uint64_t hashTile(const unsigned char* tile);
+
+	// Forgets every cell, for a new grid
+	void clear();
+
+	/**
+	* Finds the cells that have to be classified: not blank, and either without a settled
+	* majority or changed since they were last classified
+	* @param tiles the tiles of all the cells, one after the other
+	* @param toClassify out: per cell
+	* @return number of cells to classify
+	*/
+	int lookup(const unsigned char* tiles, const bool* blank, bool* toClassify);
+
+	/**
+	* Adds the answers of the classifier for the cells of lookup() as votes
+	* @param digits per cell, -1 where nothing was classified
+	* @return true if the voted digit of any cell changed or got settled
+	*/
+	bool vote(const bool* blank, const bool* classified, const int* digits);
+
+	/**
+	* The grid to solve
+	* @param digits out: per cell, 0 if blank, -1 while its majority is not settled
+	* @return true if every cell that is not blank has a digit
+	*/
+	bool votedDigits(const bool* blank, int* digits) const;
+
+private:
+	typedef struct
+	{
+		bool hasHash;
+		uint64_t hash;			// of the tile last classified
+		uint64_t pendingHash;	// of the tile of the last lookup
+		std::vector<int> votes;	// ring of the last historySize answers, -1 where empty
+		int nextVote;
+		int digit;				// majority of the votes, -1 if there is none
+		bool isSettled;			// the digit would stay the majority whatever the missing votes are
+	} Cell;
+
+	void updateMajority(Cell& cell);
+
+	int m_historySize;
+	int m_sameDistance;
+	int m_newContentDistance;
+	std::vector<Cell> m_cells;
+};
+
+#endif // !RecognitionCache_H_
@@ -0,0 +1,295 @@
+/**
+	RemoteClassifier.cpp
+	Purpose:	* Implements the shared memory ring and the socket messages of the
+				client of scripts/recognition_server.py.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "RemoteClassifier.h"
+#include "CellExtractor.h"
+#include "DigitCnn.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const size_t ALIGN = 64;
+	const size_t TILES_OFFSET = sizeof(RemoteSlotHeader);
+	const size_t TILES_BYTES = ((size_t)REMOTE_MAX_TILES * CELL_PIXELS + ALIGN - 1) / ALIGN * ALIGN;
+	const size_t PROBABILITIES_OFFSET = TILES_OFFSET + TILES_BYTES;
+	const size_t PROBABILITIES_BYTES = ((size_t)REMOTE_MAX_TILES * DIGIT_CLASSES * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN;
+	const size_t SLOT_BYTES = PROBABILITIES_OFFSET + PROBABILITIES_BYTES;
+
+	// Longest wait for the server, connecting or answering, before the connection is given up
+	const int TIMEOUT_MS = 2000;
+}
+
+RemoteClassifier::RemoteClassifier() :
+	m_socket(-1)
+	, m_segment(NULL)
+	, m_segmentBytes(0)
+	, m_slotBytes(SLOT_BYTES)
+	, m_sequence(0)
+	, m_nextSlot(0)
+{
+	std::fill(m_slotSequence, m_slotSequence + REMOTE_SLOTS, 0);
+	std::fill(m_slotAnswer, m_slotAnswer + REMOTE_SLOTS, 0);
+}
+
+RemoteClassifier::~RemoteClassifier()
+{
+	disconnect();
+}
+
+bool RemoteClassifier::load(const std::string& path)
+{
+	disconnect();
+
+#ifdef _WIN32
+	std::cout << "The recognition server needs POSIX shared memory, not available for " << path << std::endl;
+	return false;
+#else
+	// The segment of this client: header, then the ring of slots
+	static int segments = 0;
+	m_segmentName = "/sudoku_ar_" + std::to_string((long)getpid()) + "_" + std::to_string(segments++);
+	m_segmentBytes = sizeof(RemoteSegmentHeader) + REMOTE_SLOTS * m_slotBytes;
+
+	int fd = shm_open(m_segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		std::cout << "Could not create the shared memory " << m_segmentName << std::endl;
+		return false;
+	}
+	void* mapping = MAP_FAILED;
+	if (ftruncate(fd, (off_t)m_segmentBytes) == 0)
+		mapping = mmap(NULL, m_segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		std::cout << "Could not map the shared memory " << m_segmentName << std::endl;
+		shm_unlink(m_segmentName.c_str());
+		return false;
+	}
+	m_segment = (unsigned char*)mapping;
+
+	RemoteSegmentHeader* header = (RemoteSegmentHeader*)m_segment;
+	memset(header, 0, sizeof(RemoteSegmentHeader));
+	memcpy(header->magic, REMOTE_MAGIC, sizeof(header->magic));
+	header->version = REMOTE_VERSION;
+	header->slots = REMOTE_SLOTS;
+	header->slotBytes = m_slotBytes;
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	timeval timeout = { TIMEOUT_MS / 1000, (TIMEOUT_MS % 1000) * 1000 };
+	if (m_socket < 0 || setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+		|| connect(m_socket, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		std::cout << "No recognition server on " << path << " (start scripts/recognition_server.py)" << std::endl;
+		disconnect();
+		return false;
+	}
+
+	// Once the server has mapped it, the name is not needed anymore: the segment goes away with the last mapping
+	RemoteMessage hello = {};
+	hello.type = REMOTE_HELLO;
+	strncpy(hello.name, m_segmentName.c_str(), sizeof(hello.name) - 1);
+	RemoteMessage answer;
+	bool isAccepted = sendMessage(hello) && receiveMessage(answer) && answer.type == REMOTE_HELLO;
+	shm_unlink(m_segmentName.c_str());
+	if (!isAccepted)
+	{
+		std::cout << "The recognition server on " << path << " refused the shared memory" << std::endl;
+		disconnect();
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+void RemoteClassifier::disconnect()
+{
+#ifndef _WIN32
+	if (m_socket >= 0)
+		close(m_socket);
+	if (m_segment)
+	{
+		munmap(m_segment, m_segmentBytes);
+		shm_unlink(m_segmentName.c_str()); // in case the server never mapped it
+	}
+#endif
+	m_socket = -1;
+	m_segment = NULL;
+	std::fill(m_slotSequence, m_slotSequence + REMOTE_SLOTS, 0);
+	std::fill(m_slotAnswer, m_slotAnswer + REMOTE_SLOTS, 0);
+}
+
+bool RemoteClassifier::sendMessage(const RemoteMessage& message)
+{
+#ifndef _WIN32
+	const char* data = (const char*)&message;
+	size_t sent = 0;
+	while (sent < sizeof(message))
+	{
+		ssize_t n = send(m_socket, data + sent, sizeof(message) - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		sent += n;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool RemoteClassifier::receiveMessage(RemoteMessage& message)
+{
+#ifndef _WIN32
+	char* data = (char*)&message;
+	size_t received = 0;
+	while (received < sizeof(message))
+	{
+		ssize_t n = recv(m_socket, data + received, sizeof(message) - received, 0);
+		if (n <= 0)
+			return false; // closed, or no answer within TIMEOUT_MS
+		received += n;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+unsigned char* RemoteClassifier::slot(int index) const
+{
+	return m_segment + sizeof(RemoteSegmentHeader) + index * m_slotBytes;
+}
+
+uint64_t RemoteClassifier::submit(const unsigned char* tiles, const bool* skip, int count)
+{
+	if (!isLoaded() || count > REMOTE_MAX_TILES)
+		return 0;
+
+	// The oldest slot; all of them in flight means the server is far behind
+	int index = m_nextSlot;
+	if (m_slotSequence[index] != 0)
+	{
+		std::cout << "All " << REMOTE_SLOTS << " requests to the recognition server are still waiting" << std::endl;
+		return 0;
+	}
+	m_nextSlot = (m_nextSlot + 1) % REMOTE_SLOTS;
+
+	// Only the tiles to classify are copied, one after the other
+	unsigned char* base = slot(index);
+	unsigned char* out = base + TILES_OFFSET;
+	int packed = 0;
+	for (int t = 0; t < count; t++)
+	{
+		if (skip && skip[t])
+			continue;
+		memcpy(out + (size_t)packed * CELL_PIXELS, tiles + (size_t)t * CELL_PIXELS, CELL_PIXELS);
+		packed++;
+	}
+
+	RemoteSlotHeader* header = (RemoteSlotHeader*)base;
+	header->count = packed;
+	header->sequence = ++m_sequence;
+
+	RemoteMessage request = {};
+	request.type = REMOTE_REQUEST;
+	request.slot = index;
+	request.count = packed;
+	request.sequence = m_sequence;
+	if (!sendMessage(request))
+	{
+		std::cout << "Lost the recognition server" << std::endl;
+		disconnect();
+		return 0;
+	}
+
+	m_slotSequence[index] = m_sequence;
+	m_slotAnswer[index] = 0;
+	return m_sequence;
+}
+
+bool RemoteClassifier::collect(uint64_t sequence, const bool* skip, int count, int* digits, float* confidences)
+{
+	for (int t = 0; t < count; t++)
+	{
+		digits[t] = -1;
+		if (confidences)
+			confidences[t] = 0;
+	}
+
+	int index = (int)(std::find(m_slotSequence, m_slotSequence + REMOTE_SLOTS, sequence) - m_slotSequence);
+	if (sequence == 0 || index == REMOTE_SLOTS)
+		return false;
+
+	// Answers come back in the order of the requests, the ones of earlier slots are kept for their collect
+	while (m_slotAnswer[index] == 0)
+	{
+		RemoteMessage answer;
+		if (!receiveMessage(answer) || answer.slot >= REMOTE_SLOTS)
+		{
+			std::cout << "No answer from the recognition server" << std::endl;
+			disconnect();
+			return false;
+		}
+		if (m_slotSequence[answer.slot] == answer.sequence)
+			m_slotAnswer[answer.slot] = answer.type;
+	}
+
+	const unsigned char* base = slot(index);
+	const RemoteSlotHeader* header = (const RemoteSlotHeader*)base;
+	const float* probabilities = (const float*)(base + PROBABILITIES_OFFSET);
+	m_slotSequence[index] = 0;
+	if (m_slotAnswer[index] != REMOTE_RESULT || header->sequence != sequence)
+	{
+		std::cout << "The recognition server could not classify request " << sequence << std::endl;
+		return false;
+	}
+
+	int packed = 0;
+	for (int t = 0; t < count && packed < (int)header->count; t++)
+	{
+		if (skip && skip[t])
+			continue;
+		const float* row = probabilities + (size_t)packed * DIGIT_CLASSES;
+		int digit = (int)(std::max_element(row, row + DIGIT_CLASSES) - row);
+		digits[t] = digit;
+		if (confidences)
+			confidences[t] = row[digit];
+		packed++;
+	}
+	return true;
+}
+
+void RemoteClassifier::predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences)
+{
+	// One batch per call, and the calls are few: wait for it right away
+	for (int first = 0; first < count; first += REMOTE_MAX_TILES)
+	{
+		int batch = std::min(REMOTE_MAX_TILES, count - first);
+		const bool* batchSkip = skip ? skip + first : NULL;
+		uint64_t sequence = submit(tiles + (size_t)first * CELL_PIXELS, batchSkip, batch);
+		collect(sequence, batchSkip, batch, digits + first, confidences ? confidences + first : NULL);
+	}
+}
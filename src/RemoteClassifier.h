@@ -0,0 +1,112 @@
+/**
+	RemoteClassifier.h
+	Purpose:	* Recognizes the cells with scripts/recognition_server.py, a long
+				running python process that keeps the Keras network loaded, for
+				as long as not every network runs natively.
+				* The tiles and the probabilities travel through a POSIX shared
+				memory segment of the client, a ring of request slots; the Unix
+				domain socket only carries the small messages that hand a slot
+				over and back. No PNGs, no results.txt.
+				* One server serves every camera process: the requests of all
+				clients that are waiting are run as one batch.
+				* POSIX only. The layouts below must match the server.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef RemoteClassifier_H_
+#define RemoteClassifier_H_
+
+#include "DigitClassifier.h"
+
+#include <stdint.h>
+#include <string>
+
+#define REMOTE_SOCKET_PATH "/tmp/sudoku_ar_recognizer.sock"
+
+#define REMOTE_MAGIC "SUDOKUSH"
+#define REMOTE_VERSION 1
+#define REMOTE_SLOTS 4			// requests a client may have in flight
+#define REMOTE_MAX_TILES 81		// tiles of one request
+
+// Start of the shared memory segment, then REMOTE_SLOTS slots of RemoteSlot + tiles + probabilities
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t slots;
+	uint64_t slotBytes;		// size of a slot, header included
+	uint8_t reserved[40];
+} RemoteSegmentHeader;		// 64 bytes
+
+typedef struct
+{
+	uint32_t count;			// tiles of the request
+	uint32_t reserved0;
+	uint64_t sequence;		// of the request that last used the slot
+	uint8_t reserved[48];
+} RemoteSlotHeader;			// 64 bytes, then count x CELL_PIXELS tiles, then the probabilities (count x 10 floats)
+
+enum RemoteMessageType
+{
+	REMOTE_HELLO = 1,		// client -> server: map my segment 'name'. server -> client: done
+	REMOTE_REQUEST,			// client -> server: classify the tiles of 'slot'
+	REMOTE_RESULT,			// server -> client: the probabilities of 'slot' are written
+	REMOTE_ERROR			// server -> client: the request or the segment is unusable
+};
+
+// Every message on the socket, both ways
+typedef struct
+{
+	uint32_t type;
+	uint32_t slot;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t sequence;
+	char name[40];			// REMOTE_HELLO: name of the segment, for shm_open
+} RemoteMessage;			// 64 bytes
+
+class RemoteClassifier : public DigitClassifier
+{
+public:
+	RemoteClassifier();
+	~RemoteClassifier();
+
+	// Connects to the server listening on the Unix socket 'path' and shares a new segment with it
+	bool load(const std::string& path) override;
+
+	bool isLoaded() const override { return m_socket >= 0; }
+
+	void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override;
+
+	/**
+	* Hands the tiles that are not skipped to the server without waiting for them
+	* @return sequence number of the request for collect(), 0 if it could not be sent
+	*/
+	uint64_t submit(const unsigned char* tiles, const bool* skip, int count);
+
+	// Waits for the request 'sequence' of submit() and fills the answers of its tiles
+	bool collect(uint64_t sequence, const bool* skip, int count, int* digits, float* confidences = NULL);
+
+private:
+	void disconnect();
+	bool sendMessage(const RemoteMessage& message);
+	bool receiveMessage(RemoteMessage& message);
+
+	unsigned char* slot(int index) const;
+
+	int m_socket;
+	std::string m_segmentName;
+	unsigned char* m_segment;
+	size_t m_segmentBytes;
+	size_t m_slotBytes;
+
+	uint64_t m_sequence;	// of the last request
+	int m_nextSlot;
+	uint64_t m_slotSequence[REMOTE_SLOTS];	// request in flight in every slot, 0 if the slot is free
+	uint32_t m_slotAnswer[REMOTE_SLOTS];	// REMOTE_RESULT or REMOTE_ERROR once answered, 0 before
+};
+
+#endif // !RemoteClassifier_H_
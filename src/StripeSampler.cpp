@@ -0,0 +1,299 @@
+/**
+	StripeSampler.cpp
+	Purpose:	* Implements the batched stripe sampling and Sobel edge localization
+				used to refine the edges of the sudoku grid.
+				* All stripes are processed in one call, without heap allocations.
+				The bilinear samples are gathered 8 at a time with AVX2 when the
+				compiler targets it, and with plain C++ otherwise.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "StripeSampler.h"
+
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Gray value of the samples that fall outside of the image
+	const int OUTSIDE_VALUE = 127;
+
+	// Samples are gathered in blocks of 8, so rows are padded to a multiple of 8
+	const int ROW_STRIDE = (MAX_STRIPE_LENGTH + 7) & ~7;
+
+	/**
+	* Samples the three rows (m = -1, 0, 1) of a stripe into 'samples'.
+	* Row 'm + 1' holds the samples at n = nStart ... nStop
+	*/
+	void gatherStripe(const cv::Mat& gray, const StripeQuery& q, int samples[3][ROW_STRIDE])
+	{
+		const MyStripe& s = q.stripe;
+
+#ifdef __AVX2__
+		const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 maxX = _mm256_set1_ps((float)(gray.cols - 1));
+		const __m256 maxY = _mm256_set1_ps((float)(gray.rows - 1));
+		const __m256 scale = _mm256_set1_ps(256.0f);
+		const __m256i step = _mm256_set1_epi32((int)gray.step);
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256i outside = _mm256_set1_epi32(OUTSIDE_VALUE);
+
+		// 4 bytes are read per gathered pixel pair, which must stay inside the image buffer
+		const int lastSafeIndex = (int)(gray.dataend - gray.data) - 4 - (int)gray.step;
+		const __m256i safeIndex = _mm256_set1_epi32(lastSafeIndex);
+
+		for (int m = -1; m <= 1; m++)
+		{
+			float rowX = q.center.x + m * s.vecX.x;
+			float rowY = q.center.y + m * s.vecX.y;
+
+			for (int i = 0; i < s.length; i += 8)
+			{
+				__m256 n = _mm256_add_ps(lane, _mm256_set1_ps((float)(s.nStart + i)));
+				__m256 x = _mm256_add_ps(_mm256_set1_ps(rowX), _mm256_mul_ps(n, _mm256_set1_ps(s.vecY.x)));
+				__m256 y = _mm256_add_ps(_mm256_set1_ps(rowY), _mm256_mul_ps(n, _mm256_set1_ps(s.vecY.y)));
+
+				__m256 fx = _mm256_floor_ps(x);
+				__m256 fy = _mm256_floor_ps(y);
+
+				// Same bounds as subpixSampleSafe: 0 <= x < cols - 1, 0 <= y < rows - 1
+				__m256 inside = _mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(fx, zero, _CMP_GE_OQ), _mm256_cmp_ps(fx, maxX, _CMP_LT_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(fy, zero, _CMP_GE_OQ), _mm256_cmp_ps(fy, maxY, _CMP_LT_OQ)));
+				__m256i valid = _mm256_castps_si256(inside);
+
+				__m256i ix = _mm256_cvttps_epi32(fx);
+				__m256i iy = _mm256_cvttps_epi32(fy);
+				__m256i dx = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(x, fx), scale));
+				__m256i dy = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(y, fy), scale));
+
+				__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(iy, step), ix);
+				index = _mm256_and_si256(index, valid);
+
+				// Lanes whose 4-byte read would run past the end of the image are done one by one
+				__m256i overrun = _mm256_and_si256(_mm256_cmpgt_epi32(index, safeIndex), valid);
+				__m256i gatherMask = _mm256_andnot_si256(overrun, valid);
+
+				const int* base = (const int*)gray.data;
+				__m256i upperPair = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, gatherMask, 1);
+				__m256i lowerPair = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base,
+					_mm256_add_epi32(index, step), gatherMask, 1);
+
+				__m256i i0 = _mm256_and_si256(upperPair, byteMask);
+				__m256i i1 = _mm256_and_si256(_mm256_srli_epi32(upperPair, 8), byteMask);
+				__m256i i2 = _mm256_and_si256(lowerPair, byteMask);
+				__m256i i3 = _mm256_and_si256(_mm256_srli_epi32(lowerPair, 8), byteMask);
+
+				__m256i upper = _mm256_add_epi32(i0, _mm256_srai_epi32(_mm256_mullo_epi32(dx, _mm256_sub_epi32(i1, i0)), 8));
+				__m256i lower = _mm256_add_epi32(i2, _mm256_srai_epi32(_mm256_mullo_epi32(dx, _mm256_sub_epi32(i3, i2)), 8));
+				__m256i value = _mm256_add_epi32(upper, _mm256_srai_epi32(_mm256_mullo_epi32(dy, _mm256_sub_epi32(lower, upper)), 8));
+
+				value = _mm256_blendv_epi8(outside, value, valid);
+				_mm256_storeu_si256((__m256i*)&samples[m + 1][i], value);
+
+				if (!_mm256_testz_si256(overrun, overrun))
+				{
+					int lanes[8];
+					_mm256_storeu_si256((__m256i*)lanes, overrun);
+					for (int l = 0; l < 8; l++)
+					{
+						if (lanes[l] == 0)
+							continue;
+						float nn = (float)(s.nStart + i + l);
+						samples[m + 1][i + l] = StripeSampler::subpixSampleSafe(gray,
+							cv::Point2f(rowX + nn * s.vecY.x, rowY + nn * s.vecY.y));
+					}
+				}
+			}
+		}
+#else
+		for (int m = -1; m <= 1; m++)
+		{
+			for (int n = s.nStart; n <= s.nStop; n++)
+			{
+				cv::Point2f subPixel;
+				subPixel.x = q.center.x + ((double)m * s.vecX.x) + ((double)n * s.vecY.x);
+				subPixel.y = q.center.y + ((double)m * s.vecX.y) + ((double)n * s.vecY.y);
+
+				samples[m + 1][n - s.nStart] = StripeSampler::subpixSampleSafe(gray, subPixel);
+			}
+		}
+#endif
+	}
+
+	/**
+	* Applies the Sobel operator across the stripe. The three rows are first collapsed
+	* with the (1, 2, 1) smoothing weights, then the derivative (-1, 0, 1) is taken along
+	* the length: sobel[j] belongs to the stripe sample j + 1
+	*/
+	int sobelStripe(int samples[3][ROW_STRIDE], int length, int sobel[ROW_STRIDE])
+	{
+		int smoothed[ROW_STRIDE + 8];
+
+#ifdef __AVX2__
+		for (int i = 0; i < length; i += 8)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i*)&samples[0][i]);
+			__m256i b = _mm256_loadu_si256((const __m256i*)&samples[1][i]);
+			__m256i c = _mm256_loadu_si256((const __m256i*)&samples[2][i]);
+			__m256i sum = _mm256_add_epi32(_mm256_add_epi32(a, c), _mm256_slli_epi32(b, 1));
+			_mm256_storeu_si256((__m256i*)&smoothed[i], sum);
+		}
+		for (int j = 0; j < length - 2; j += 8)
+		{
+			__m256i prev = _mm256_loadu_si256((const __m256i*)&smoothed[j]);
+			__m256i next = _mm256_loadu_si256((const __m256i*)&smoothed[j + 2]);
+			_mm256_storeu_si256((__m256i*)&sobel[j], _mm256_sub_epi32(next, prev));
+		}
+#else
+		for (int i = 0; i < length; i++)
+			smoothed[i] = samples[0][i] + 2 * samples[1][i] + samples[2][i];
+		for (int j = 0; j < length - 2; j++)
+			sobel[j] = smoothed[j + 2] - smoothed[j];
+#endif
+
+		return length - 2;
+	}
+
+	/**
+	* Sub-pixel offset of the peak 'index' of 'values': uses the peak and its two neighbors
+	* as positions -1, 0 and 1 on the x axis and returns the x-coordinate of the vertex of
+	* the parabola through them. NaN when no parabola can be fitted
+	*/
+	double peakOffset(const int* values, int count, int index)
+	{
+		double y0 = (index == 0) ? 0 : values[index - 1];
+		double y1 = values[index];
+		double y2 = (index == (count - 1)) ? 0 : values[index + 1];
+
+		return (y2 - y0) / (4 * y1 - 2 * y0 - 2 * y2);
+	}
+}
+
+void StripeSampler::locateEdges(const cv::Mat& gray, const StripeQuery* queries, int count, cv::Point2f* edges)
+{
+	// Scratch space lives on the stack and is reused by every stripe
+	int samples[3][ROW_STRIDE];
+	int sobel[ROW_STRIDE + 8];
+
+	for (int k = 0; k < count; k++)
+	{
+		const StripeQuery& q = queries[k];
+		const MyStripe& s = q.stripe;
+
+		gatherStripe(gray, q, samples);
+		int numSobelValues = sobelStripe(samples, s.length, sobel);
+
+		// Find the MAX Sobel value and its index
+		int maxVal = -1;
+		int maxIndex = 0;
+		for (int n = 0; n < numSobelValues; ++n)
+		{
+			if (sobel[n] > maxVal)
+			{
+				maxVal = sobel[n];
+				maxIndex = n;
+			}
+		}
+
+		double pos = peakOffset(sobel, numSobelValues, maxIndex);
+
+		if (pos != pos) {
+			// value is not a number, so return the original
+			// "inaccurate" location of the delimiter
+			edges[k] = cv::Point2f((float)q.center.x, (float)q.center.y);
+			continue;
+		}
+
+		// Sobel value 'maxIndex' belongs to the stripe sample 'maxIndex + 1'
+		int maxIndexShift = maxIndex + 1 + s.nStart;
+
+		// Shift the original edgepoint along the stripe's length
+		edges[k].x = (float)(q.center.x + ((double)maxIndexShift + pos) * s.vecY.x);
+		edges[k].y = (float)(q.center.y + ((double)maxIndexShift + pos) * s.vecY.y);
+	}
+}
+
+int StripeSampler::locateLines(const cv::Mat& gray, const StripeQuery* queries, int count, int minResponse,
+	cv::Point2f* lines, bool* found)
+{
+	int samples[3][ROW_STRIDE];
+	int sobel[ROW_STRIDE + 8];
+	int numFound = 0;
+
+	for (int k = 0; k < count; k++)
+	{
+		const StripeQuery& q = queries[k];
+		const MyStripe& s = q.stripe;
+
+		lines[k] = cv::Point2f((float)q.center.x, (float)q.center.y);
+		found[k] = false;
+
+		gatherStripe(gray, q, samples);
+		int numSobelValues = sobelStripe(samples, s.length, sobel);
+
+		// Strongest falling (min) and rising (max) edges
+		int minIndex = 0, maxIndex = 0;
+		for (int n = 1; n < numSobelValues; ++n)
+		{
+			if (sobel[n] < sobel[minIndex])
+				minIndex = n;
+			if (sobel[n] > sobel[maxIndex])
+				maxIndex = n;
+		}
+
+		// Crossing a dark line, the gray value first falls and then rises again
+		if (minIndex >= maxIndex || -sobel[minIndex] < minResponse || sobel[maxIndex] < minResponse)
+			continue;
+
+		// Fit the falling edge on the negated values, so that it is a maximum too
+		int negated[3];
+		for (int i = 0; i < 3; i++) {
+			int n = minIndex - 1 + i;
+			negated[i] = (n >= 0 && n < numSobelValues) ? -sobel[n] : 0;
+		}
+		double fallPos = peakOffset(negated, 3, 1);
+		double risePos = peakOffset(sobel, numSobelValues, maxIndex);
+		if (fallPos != fallPos || risePos != risePos)
+			continue;
+
+		// Sobel value 'n' belongs to the stripe sample 'n + 1'
+		double center = 0.5 * ((minIndex + fallPos) + (maxIndex + risePos)) + 1 + s.nStart;
+
+		lines[k].x = (float)(q.center.x + center * s.vecY.x);
+		lines[k].y = (float)(q.center.y + center * s.vecY.y);
+		found[k] = true;
+		numFound++;
+	}
+
+	return numFound;
+}
+
+int StripeSampler::subpixSampleSafe(const cv::Mat& gray, const cv::Point2f& p)
+{
+	int x = int(floorf(p.x));
+	int y = int(floorf(p.y));
+
+	if (x < 0 || x >= gray.cols - 1 ||
+		y < 0 || y >= gray.rows - 1)
+		return OUTSIDE_VALUE;
+
+	int dx = int(256 * (p.x - floorf(p.x)));
+	int dy = int(256 * (p.y - floorf(p.y)));
+
+	// Pointer to the pixel with the smallest coordinates nearest to point 'p'
+	const unsigned char* i = gray.data + y * gray.step + x;
+
+	// Average of the two UPPER pixels, then of the two LOWER ones, then between both rows
+	int upper_row_avg = i[0] + ((dx * (i[1] - i[0])) >> 8);
+	i += gray.step;
+	int lower_row_avg = i[0] + ((dx * (i[1] - i[0])) >> 8);
+
+	return upper_row_avg + ((dy * (lower_row_avg - upper_row_avg)) >> 8);
+}
@@ -0,0 +1,64 @@
+/**
+	StripeSampler.h
+	Purpose:	* Sub-pixel edge localization along many stripes at once.
+				Every stripe is sampled bilinearly, filtered with a 3x3 Sobel
+				kernel along its length and the edge is found by fitting a
+				parabola through the strongest response.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef StripeSampler_H_
+#define StripeSampler_H_
+
+#include "opencv2/core.hpp"
+
+// Longest stripe we sample (in pixels). Must be odd
+#define MAX_STRIPE_LENGTH 127
+
+typedef struct
+{
+	int length;
+	int nStop;
+	int nStart;
+	cv::Point2f vecX; // direction vector of the stripe's width
+	cv::Point2f vecY; // direction vector of the stripe's length
+} MyStripe;
+
+typedef struct
+{
+	cv::Point center;	// rough location of the edge (a delimiter)
+	MyStripe stripe;	// stripe that is laid across the edge at 'center'
+} StripeQuery;
+
+namespace StripeSampler
+{
+	/**
+	* Finds the exact location of the edge crossed by every stripe
+	* @param gray 8-bit gray image the stripes are sampled from
+	* @param queries 'count' stripes, every one with its own center and geometry
+	* @param edges output, one sub-pixel edge location per query. If no parabola
+	*        can be fitted, the center of the query is returned
+	*/
+	void locateEdges(const cv::Mat& gray, const StripeQuery* queries, int count, cv::Point2f* edges);
+
+	/**
+	* Finds the center of the dark line crossed by every stripe. The line is where the
+	* strongest falling edge is followed by the strongest rising edge along the stripe
+	* @param minResponse smallest Sobel response accepted for both edges
+	* @param lines output, one sub-pixel line center per query
+	* @param found output, whether a line was found for the query
+	* @return number of queries for which a line was found
+	*/
+	int locateLines(const cv::Mat& gray, const StripeQuery* queries, int count, int minResponse,
+		cv::Point2f* lines, bool* found);
+
+	/**
+	* Returns the color of the subpixel by looking at the four pixels that surround it
+	*/
+	int subpixSampleSafe(const cv::Mat& gray, const cv::Point2f& p);
+}
+
+#endif // !StripeSampler_H_
@@ -16,10 +16,10 @@
 
 #include <iomanip>
 
-#include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/core.hpp"
-#include "opencv2/opencv.hpp"
+#include "opencv2/calib3d.hpp"
+#include "opencv2/imgcodecs.hpp"
 
 #include <iostream>
 #include <stdlib.h>
@@ -27,6 +27,15 @@
 #include <fstream>
 
 #include "PoseEstimation.h"
+#include "StripeSampler.h"
+#include "CellExtractor.h"
+#include "CellTensor.h"
+#include "WarpCache.h"
+#include "ThresholdController.h"
+#include "ChangeDetector.h"
+#include "DebugRecorder.h"
+#include "DigitClassifier.h"
+#include "RecognitionCache.h"
 
 #define DELIMITERS 6
 
@@ -34,59 +43,221 @@
 #define N 9
 #define NN 81
 
+// The grid is drawn with 10 horizontal and 10 vertical lines, which cross at 100 points
+#define LATTICE_LINES 10
+#define LATTICE_POINTS 100
+
+// States of the detection / tracking / locked-solution machine
+enum TrackingState
+{
+	SEARCHING = 0,	// No grid known: look for it in the whole frame
+	TRACKING,		// Grid known: re-fit it around the last corners, wait for the OCR
+	SOLVED_LOCKED,	// Solution known: only track the pose and re-render the cached overlay
+	LOST,			// Grid lost while a solution is cached: re-detect, keep the solution
+	NUM_TRACKING_STATES
+};
+
+// Units of work that processFrame can do on a frame. Every state has its own work list
+enum FrameWork
+{
+	WORK_THRESHOLD		= 1 << 0,	// adaptive threshold of the whole frame
+	WORK_DETECT			= 1 << 1,	// contour search for the grid (findSudoku)
+	WORK_TRACK			= 1 << 2,	// re-fit the edges around the last corners (trackSudoku)
+	WORK_WARP			= 1 << 3,	// warp the grid into m_sudoku, if the grid image is asked for
+	WORK_EXTRACT		= 1 << 4,	// extract the 81 subimages
+	WORK_OCR			= 1 << 5,	// recognize and solve
+	WORK_CHECK_CONTENT	= 1 << 6,	// compare the grid against the one that was solved
+	WORK_RENDER			= 1 << 7,	// reproject the cached solution
+	WORK_POSE			= 1 << 8,	// estimate the pose of the grid
+	WORK_LATTICE		= 1 << 9	// refine the 100 intersections of the grid lines
+};
+
+// How the grid is straightened before the subimages are extracted
+enum WarpMode
+{
+	WARP_PLANAR = 0,	// one homography from the 4 corners (flat page)
+	WARP_MESH			// one homography per cell from the lattice points (curled page)
+};
+
+// A grid line of the lattice: the straight line (vx, vy, x0, y0) of cv::fitLine, bent away
+// from it along its normal by bend[0] + bend[1] * s + bend[2] * s^2, s pixels from (x0, y0)
 typedef struct
 {
-	int length;
-	int nStop;
-	int nStart;
-	cv::Point2f vecX; // direction vector of the stripe's width
-	cv::Point2f vecY; // direction vector of the stripe's length
-} MyStripe;
+	cv::Vec4f line;
+	double bend[3];
+} LatticeCurve;
+
+// How good the view of the grid is for the OCR
+typedef struct
+{
+	double sharpness;		// variance of the Laplacian of the straightened gray grid
+	double cornerResidual;	// RMS distance (pixels) of the edge points to the fitted edges
+	double obliquity;		// angle (degrees) between the line of sight and the normal of the page
+	int distanceCm;			// distance to the grid, -1 if no pose is known yet
+	double score;			// all of the above combined, 0 (useless) ... 1 (perfect)
+	bool isGoodForOcr;		// score >= QUALITY_MIN_SCORE
+} FrameQuality;
+
+// Settings of the engine, what the trackbars used to hold
+typedef struct
+{
+	double sudokuSize;		// side of the grid, in meters
+	int blockSize;			// adaptive threshold: odd, >= 3
+	int thresholdC;			// adaptive threshold: subtracted from the local mean
+	bool autoThreshold;		// let the ThresholdController adapt the two above to the grid
+	int minArea;			// smallest bounding box (pixels) of a grid candidate
+	int maxArea;
+	bool grayFlag;			// extract the subimages from the gray frame instead of the binary one
+	WarpMode warpMode;
+	DigitBackend digitBackend;	// which DigitClassifier recognizes the cells
+	std::string modelPath;	// model of that backend, DigitClassifier::defaultModelPath if empty
+	bool trackPencilIn;		// while the solution is shown, read the digits written into the grid
+	bool renderGridImage;	// straighten the whole grid into SudokuResult::gridImage (always with SUDOKU_AR_DEBUG_DRAW)
+} SudokuConfig;
+
+// Where the time of a frame went, in milliseconds
+typedef struct
+{
+	double threshold;
+	double detect;		// contour search or tracking, with the subpixel corners
+	double lattice;
+	double extract;		// warp and subimages
+	double ocr;			// recognition and solving
+	double pose;
+	double total;
+} SudokuTimings;
+
+// Everything the engine knows after a frame
+typedef struct
+{
+	bool isGridFound;
+	bool isReused;				// static scene: copied from the last processed frame
+	TrackingState state;
+	cv::Point2f corners[4];		// top-left, bottom-left, bottom-right, top-right (image coords)
+	bool hasLattice;
+	cv::Point2f latticePoints[LATTICE_POINTS];
+	bool isSolved;				// digits and solution are valid
+	int digits[NN];				// recognized digits (row-major), UNASSIGNED for empty cells
+	int solution[NN];			// the solved grid (row-major)
+	int entries[NN];			// digits written in since the grid was solved, UNASSIGNED where none
+	bool isEntryWrong[NN];		// entries that are not the digit of the solution
+	bool hasPose;
+	float pose[16];				// row-major 4x4 transformation of the grid, in camera coords
+	FrameQuality quality;
+	ThresholdParams threshold;	// adaptive threshold the frame was binarized with
+	SudokuTimings timings;
+	cv::Mat gridImage;			// straightened grid, with the solution once solved. Empty if not asked for (renderGridImage)
+	cv::Mat debugImage;			// frame with the debug drawings, only with SUDOKU_AR_DEBUG_DRAW
+} SudokuResult;
 
 class SudokuAR
 {
 public:
-	SudokuAR(double markerSize);
+	SudokuAR(const SudokuConfig& config);
 	~SudokuAR();
 
-	bool processNextFrame(cv::Mat &img_bgr, float resultMatrix[16]);
+	// Default settings for a grid of side 'sudokuSize' (meters)
+	static SudokuConfig defaultConfig(double sudokuSize);
+
+	const SudokuConfig& getConfig() const;
+	void setConfig(const SudokuConfig& config);
+
+	// Recognizes the cells with 'classifier' instead of the one of the configuration, e.g. a
+	// client of the BatchScheduler shared by the engines of several streams. It is kept when
+	// the configuration changes its model; NULL goes back to the model of the configuration
+	void setClassifier(std::unique_ptr<DigitClassifier> classifier);
+
+	/**
+	* Detects, tracks and solves the grid in 'img_bgr' and renders the solution onto it
+	* @param result what was found in the frame
+	* @return false if the frame is empty
+	*/
+	bool processFrame(cv::Mat &img_bgr, SudokuResult& result);
+
+	// Copies the 100 grid intersections of the last frame (row-major, 10 x 10). False if unknown
+	bool getLatticePoints(cv::Point2f points[LATTICE_POINTS]) const;
+
+	// Quality of the last frame that was considered for the OCR
+	const FrameQuality& getFrameQuality() const;
+
+	// Name of 'state' for logs. The engine itself prints nothing, SudokuResult holds what it found
+	static const char* stateName(TrackingState state);
 
 private:
-	char key;
 	bool m_playVideo;
 	bool m_isFirstStripe;
 	bool m_isFirstMarker;
 
-	double m_sudokuSize;
+	SudokuConfig m_config;
 	bool m_saveSubimages;
 	bool m_printSolution;
-	bool m_grayFlag;
 
+	int m_recognizedDigits[NN];
 	int m_differenceRow[NN];
 	int m_distanceToSudokuInCm;
+	bool m_hasPose;
+	double m_obliquity; // of the last pose, in degrees
+	double m_cornerResidual; // of the last processCorners, in pixels
+	FrameQuality m_quality;
+
+	cv::Point2f m_stableCorners[4]; // Corners at the start of the current stable episode
+	int m_stableFrames; // Frames the corners have stayed around m_stableCorners
+	bool m_hasStableCorners;
+	bool m_ocrFired; // The grid was already solved (or tried) in the current stable episode
+
+	ChangeDetector m_changeDetector;
+	cv::Rect m_watchRoi; // Grid of the last processed frame and its surroundings, empty if no grid
+	SudokuResult m_lastResult; // Result of the last processed frame, filled in while processing
+	cv::Mat m_reprojectedOverlay; // Solution digits of the last processed frame, in frame coords
+
+	TrackingState m_state;
+	int m_lostFrames;
+	int m_framesSinceContentCheck;
+
+	bool m_hasTrackedCorners;
+	cv::Point2f m_trackedCorners[4]; // Ordered exact corners of the last frame (image coords)
+	cv::Point m_trackedPoints[4];
+
+	cv::Mat m_solutionOverlay; // Digits of the solution drawn on black, in grid coords
+	unsigned char m_lockedSignature[NN]; // Which cells had ink when the grid was solved
+
+	int m_entries[NN]; // Digits written in since the solution was locked, UNASSIGNED where none
+	bool m_isEntryWrong[NN]; // Entries that are not the digit of the solution
+	int m_inkFrames[NN]; // Frames in a row an empty cell of the solved grid has shown ink
+	bool m_hasPendingInk; // Some cell has ink that is not stable or not read for sure yet: no frame is skipped
+
+	cv::Mat m_meshMapX, m_meshMapY; // Fixed-point remap tables of the mesh warp
+	cv::Point2f m_meshLattice[LATTICE_POINTS]; // Lattice points the mesh tables were built for
+
+	bool m_hasLattice;
+	cv::Point2f m_latticePoints[LATTICE_POINTS]; // Intersection of horizontal line 'i' and vertical 'j' at i * 10 + j
+
+	WarpCache m_warpCache; // Projection, lattice, planar warp tables and tile projections, reused while the grid stays put
 
 	////////////////////////////////////////////////////////////////////////
 	
 	cv::Mat m_src, m_gray, m_threshold, m_sudoku, m_dst, img_bgr;
-	cv::Mat m_subimages[81];
+	DebugRecorder m_debug; // Drawings for m_dst, only kept with SUDOKU_AR_DEBUG_DRAW
+	CellTensor m_cells; // The 81 tiles, NN x 1 x CELL_SIZE x CELL_SIZE, allocated once
+	std::unique_ptr<DigitClassifier> m_classifier; // Recognizes the tiles in process, if its model could be loaded
+	bool m_isClassifierInjected; // m_classifier came from setClassifier: never replaced by the model of m_config
+	RecognitionCache m_recognitionCache; // Votes of the last recognitions of every cell, by the hash of its tile
+	cv::Mat m_subimages[81]; // Non-owning views of the tiles of m_cells
+	bool m_blankCells[NN]; // Cells found empty before recognition
+	double m_inkThreshold; // Gray level between ink and paper of the last extraction of all the cells, -1 before
 
-	std::vector<std::vector<cv::Point>> m_contours; // Vector for storing contour
-	std::vector<cv::Vec4i> m_hierarchy;
 	std::vector<cv::Point> m_approx;
-	std::vector<cv::Point> m_approxChild;
-	cv::Point* m_square;
 
-	cv::Rect m_boundingBox;
 	cv::Point *m_sudokuCorners;
 	cv::Point2f m_exactSudokuCorners[4];
 
 	static const cv::Scalar numbersColor;
+	static const cv::Scalar wrongEntryColor;
 
 	static const int numberOfSides;
 	static const int nOfIntervals;
 
 	MyStripe m_stripe;
-	cv::Mat m_iplStripe;
 
 	// We will have 4 lines, one for each side of the square
 	// And each line is defined by 4 floats: 2 contain the direction, 2 a point
@@ -95,51 +266,79 @@ private:
 	
 	////////////////////////////////////////////////////////////////////////
 
-	static void onBlockSizeSlider(int, void*);
-	
+	void setState(TrackingState state);
+	void onGridLost();
+	void onContentChanged();
 	void orderCorners();
 	cv::Point* findSudoku();
-	bool perspectiveTransform(cv::Point2f* corners, cv::Mat& projMatInv);
-	void reprojectSolution(const cv::Mat& projMatInv, cv::Mat& img_bgr);
-	void extractSubimagesAndSaveToFolder(bool saveSubimages);
+	cv::Point* findSudokuWithCandidates();
+	static bool findGridContour(const cv::Mat& binary, int minArea, std::vector<cv::Point>& quad);
+	bool trackSudoku();
+	bool computeProjection(cv::Point2f* corners, cv::Mat& projMat, cv::Mat& projMatInv);
+	void perspectiveTransform(const cv::Mat& projMatInv);
+	void buildMeshMaps(cv::Mat& mapX, cv::Mat& mapY);
+	void reprojectSolution(const cv::Mat& overlay, const cv::Mat& projMatInv, cv::Mat& img_bgr);
+	void extractSubimages(const cv::Mat& projMatInv, const bool* mask = NULL);
 	bool solve();
-	void drawSolution();
-	void drawNumber(int number, unsigned row, unsigned col);
-	cv::Mat fineCropGray(const cv::Mat& img);
-	cv::Mat fineCropBinary(const cv::Mat& img);
+	void lockSolution(const cv::Mat& projMat);
+	void computeContentSignature(const cv::Mat& projMat, unsigned char signature[NN]);
+	bool hasContentChanged(const unsigned char signature[NN]);
+	void clearEntries();
+	void updateEntries(const unsigned char signature[NN], const cv::Mat& projMatInv);
+	void drawSolution(cv::Mat& canvas);
+	void drawNumber(cv::Mat& canvas, int number, unsigned row, unsigned col);
 	void estimateSudokuPose(float resultMatrix[16]); // CHANGED
+	void updateFrameQuality(const cv::Mat& projMat);
+	void updateStability();
+	bool reuseLastFrame(cv::Mat& img_bgr, SudokuResult& result);
+	void fillResult(bool isGridFound, int64 frameStart, SudokuResult& result);
+	void loadClassifier(); // Classifier of m_config.digitBackend, with its model
+	bool recognizeCells(); // Classifies the cells that are not settled or changed, true if the voted grid changed
+	bool shouldTriggerOcr();
 	void processCorners();
+	bool processLattice(cv::Mat& projMat, cv::Mat& projMatInv);
+	static bool intersectLines(const cv::Vec4f& a, const cv::Vec4f& b, cv::Point2f& p);
+	static bool fitLatticeCurve(const std::vector<cv::Point2f>& points, bool isCurved, LatticeCurve& curve);
+	static bool intersectCurves(const LatticeCurve& a, const LatticeCurve& b, cv::Point2f& p);
 	void computeStripe(double dx, double dy);
-	cv::Point2f computeAccurateDelimiter(cv::Point p);
-	int subpixSampleSafe(const cv::Mat& gray, const cv::Point2f& p);
-	cv::Point2f computeSobel(cv::Point p);
 	
 	////////////////////////////////////////////////////////////////////////
 
-	static const std::string resultsWindow;
-	static const std::string sudokuWindow;
-	static const std::string trackbarsWindow;
-
-	static const std::string thresholdTrackbarName;
-	static const std::string blockSizeTrackbarName;
-	static const std::string constTrackbarName;
-
-	static const int blockSizeSliderMax;
-	int m_blockSizeSlider;
-
-	static const int constSliderMax;
-	int m_constSlider;
-
-	static const int markerThresholdSliderMax;
-	int m_markerThresholdSlider;
-
-	static const std::string minAreaTrackbarName;
-	static const std::string maxAreaTrackbarName;
-	static const int MAX_AREA;
-	int m_minArea;
-	int m_maxArea;
+	ThresholdController m_thresholdController; // Adapts the threshold of m_config, if autoThreshold
+	bool m_isThresholdManual; // The threshold was set by hand: not adapted until the grid is lost
 
 	static const int MIN_NUM_OF_BOXES;
+
+	static const unsigned stateWork[NUM_TRACKING_STATES];
+	static const char* stateNames[NUM_TRACKING_STATES];
+	static const int MAX_LOST_FRAMES;
+	static const int CONTENT_CHECK_INTERVAL;
+	static const int CONTENT_CELL_PIXELS;
+	static const double CONTENT_INK_STDDEV;
+	static const int CONTENT_CHANGED_CELLS;
+	static const int PENCIL_STABLE_FRAMES;
+	static const int LATTICE_MIN_RESPONSE;
+	static const int LATTICE_MIN_POINTS_PER_LINE;
+	static const double LATTICE_MAX_DEVIATION;
+	static const double LATTICE_MAX_MESH_DEVIATION;
+	static const int LATTICE_CURVE_ITERATIONS;
+	static const double CELL_MARGIN;
+	static const float WARP_CACHE_TOLERANCE;
+	static const int QUALITY_GRID_SIZE;
+	static const double QUALITY_SHARPNESS_REF;
+	static const double QUALITY_MAX_RESIDUAL;
+	static const double QUALITY_MAX_OBLIQUITY;
+	static const int QUALITY_MAX_DISTANCE_CM;
+	static const double QUALITY_MIN_SCORE;
+	static const int STABLE_MIN_FRAMES;
+	static const float STABLE_TOLERANCE;
+	static const int CHANGE_THUMBNAIL_WIDTH;
+	static const int CHANGE_PIXEL_THRESHOLD;
+	static const double CHANGE_MAX_RATIO;
+	static const double CHANGE_ROI_MARGIN;
+	static const int RECOGNITION_HISTORY;
+	static const int RECOGNITION_SAME_DISTANCE;
+	static const int RECOGNITION_NEW_CONTENT_DISTANCE;
 	
 	int m_maxWidth;
 	int m_maxHeight;
@@ -0,0 +1,114 @@
+/**
+	SudokuViewer.cpp
+	Purpose:	* Implements the windows and trackbars of the SudokuAR engine.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "SudokuViewer.h"
+
+#include "opencv2/highgui.hpp"
+
+const std::string SudokuViewer::resultsWindow = "Result";
+const std::string SudokuViewer::sudokuWindow = "Sudoku";
+
+const std::string SudokuViewer::blockSizeTrackbarName = "block size";
+const std::string SudokuViewer::constTrackbarName = "C";
+const std::string SudokuViewer::minAreaTrackbarName = "min area";
+const std::string SudokuViewer::maxAreaTrackbarName = "max area";
+
+const int SudokuViewer::blockSizeSliderMax = 1001;
+const int SudokuViewer::constSliderMax = 100;
+const int SudokuViewer::MAX_AREA = 30000;
+
+SudokuViewer::SudokuViewer(const SudokuConfig& config) :
+	m_blockSizeSlider(config.blockSize)
+	, m_constSlider(config.thresholdC)
+	, m_minArea(config.minArea)
+	, m_maxArea(config.maxArea)
+	, m_shownState(SEARCHING)
+{
+	m_shownThreshold.blockSize = config.blockSize;
+	m_shownThreshold.c = config.thresholdC;
+
+#ifdef SUDOKU_AR_DEBUG_DRAW
+	cv::namedWindow(resultsWindow, CV_WINDOW_AUTOSIZE);
+	cv::moveWindow(resultsWindow, 300, 700);
+#endif
+
+	cv::namedWindow(sudokuWindow, CV_WINDOW_NORMAL);
+	cv::resizeWindow(sudokuWindow, 500, 700);
+	cv::moveWindow(sudokuWindow, 1200, 600);
+
+	cv::createTrackbar(blockSizeTrackbarName, sudokuWindow,
+		&m_blockSizeSlider, blockSizeSliderMax, onBlockSizeSlider, this);
+	cv::createTrackbar(constTrackbarName, sudokuWindow,
+		&m_constSlider, constSliderMax);
+	cv::createTrackbar(minAreaTrackbarName, sudokuWindow,
+		&m_minArea, MAX_AREA);
+	cv::createTrackbar(maxAreaTrackbarName, sudokuWindow,
+		&m_maxArea, MAX_AREA);
+}
+
+SudokuViewer::~SudokuViewer()
+{
+	cv::destroyAllWindows();
+}
+
+void SudokuViewer::onBlockSizeSlider(int v, void* ptr)
+{
+	// resolve 'this':
+	SudokuViewer *that = (SudokuViewer*)ptr;
+
+	if (that->m_blockSizeSlider % 2 == 0)
+		that->m_blockSizeSlider -= 1;
+	if (that->m_blockSizeSlider < 3)
+		that->m_blockSizeSlider = 3;
+}
+
+bool SudokuViewer::show(const SudokuResult& result, SudokuAR& engine)
+{
+	if (!result.debugImage.empty())
+		cv::imshow(resultsWindow, result.debugImage);
+	if (!result.gridImage.empty())
+		cv::imshow(sudokuWindow, result.gridImage);
+
+	// The engine prints nothing: its state changes are logged here
+	if (result.state != m_shownState) {
+		std::cout << "State: " << SudokuAR::stateName(m_shownState) << " -> " << SudokuAR::stateName(result.state) << std::endl;
+		m_shownState = result.state;
+	}
+
+	// The engine adapted the threshold: follow it
+	if (result.threshold.blockSize != m_shownThreshold.blockSize || result.threshold.c != m_shownThreshold.c) {
+		m_shownThreshold = result.threshold;
+		m_blockSizeSlider = m_shownThreshold.blockSize;
+		m_constSlider = m_shownThreshold.c;
+		cv::setTrackbarPos(blockSizeTrackbarName, sudokuWindow, m_blockSizeSlider);
+		cv::setTrackbarPos(constTrackbarName, sudokuWindow, m_constSlider);
+	}
+
+	// Read input key from user
+	char key = (char)cv::waitKey(1);
+	if (key == 'q' || key == 'Q') {
+		std::cout << "ciao" << std::endl;
+		return false;
+	}
+
+	// Trackbars moved by hand: the engine takes over their values
+	SudokuConfig config = engine.getConfig();
+	if (m_blockSizeSlider != m_shownThreshold.blockSize || m_constSlider != m_shownThreshold.c
+		|| m_minArea != config.minArea || m_maxArea != config.maxArea) {
+		config.blockSize = m_blockSizeSlider;
+		config.thresholdC = m_constSlider;
+		config.minArea = m_minArea;
+		config.maxArea = m_maxArea;
+		engine.setConfig(config);
+
+		m_shownThreshold.blockSize = m_blockSizeSlider;
+		m_shownThreshold.c = m_constSlider;
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+/**
+	SudokuViewer.h
+	Purpose:	* Shows the results of the SudokuAR engine in HighGUI windows:
+				the straightened grid and, with SUDOKU_AR_DEBUG_DRAW, the frame
+				with the debug drawings.
+				* Its trackbars edit the SudokuConfig of the engine and follow
+				the adaptive threshold while the engine adapts it.
+				* The engine itself never opens a window, so it also runs on
+				machines without a display.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef SudokuViewer_H_
+#define SudokuViewer_H_
+
+#include "SudokuAR.h"
+
+#include <string>
+
+class SudokuViewer
+{
+public:
+	// Creates the windows, with the trackbars set to 'config'
+	SudokuViewer(const SudokuConfig& config);
+	~SudokuViewer();
+
+	/**
+	* Shows 'result' and hands the trackbars that were moved by hand to 'engine'
+	* @return false if the user asked to quit
+	*/
+	bool show(const SudokuResult& result, SudokuAR& engine);
+
+private:
+	static void onBlockSizeSlider(int, void*);
+
+	int m_blockSizeSlider;
+	int m_constSlider;
+	int m_minArea;
+	int m_maxArea;
+	ThresholdParams m_shownThreshold; // What the threshold trackbars showed after the last frame
+	TrackingState m_shownState; // State of the engine after the last frame
+
+	static const std::string resultsWindow;
+	static const std::string sudokuWindow;
+
+	static const std::string blockSizeTrackbarName;
+	static const std::string constTrackbarName;
+	static const std::string minAreaTrackbarName;
+	static const std::string maxAreaTrackbarName;
+
+	static const int blockSizeSliderMax;
+	static const int constSliderMax;
+	static const int MAX_AREA;
+};
+
+#endif // !SudokuViewer_H_
@@ -0,0 +1,118 @@
+/**
+	ThresholdController.cpp
+	Purpose:	* Implements the adaptation of the adaptive threshold to the grid.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "ThresholdController.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+	const int CELLS_PER_SIDE = 9;
+
+	// The mean is taken over about half a cell: wide next to the lines, narrow next to the light
+	const double BLOCK_PER_CELL = 0.5;
+	const int MIN_BLOCK_SIZE = 3;
+	const int MAX_BLOCK_SIZE = 151;
+
+	// C as a multiple of the mean deviation of the pixels from their local mean
+	const double C_PER_DEVIATION = 1.0;
+	const int MIN_C = 2;
+	const int MAX_C = 40;
+
+	// Share of the new estimate taken in every frame
+	const double SMOOTHING = 0.5;
+
+	// Block sizes tried when the grid is lost, from far (small cells) to close (big cells)
+	const int CANDIDATE_BLOCK_SIZES[] = { 7, 11, 17, 27, 43, 69, 111 };
+	const int MAX_CANDIDATES = 6;
+}
+
+ThresholdController::ThresholdController(int blockSize, int c) :
+	m_blockSize(blockSize)
+	, m_c(c)
+{
+	m_params.blockSize = toBlockSize(blockSize);
+	m_params.c = c;
+}
+
+void ThresholdController::setParams(const ThresholdParams& params)
+{
+	m_params = params;
+	m_blockSize = params.blockSize;
+	m_c = params.c;
+}
+
+void ThresholdController::update(const cv::Mat& gray, const cv::Point2f corners[4])
+{
+	std::vector<cv::Point2f> quad(corners, corners + 4);
+	double cellSize = sqrt(cv::contourArea(quad)) / CELLS_PER_SIDE;
+	if (cellSize < 1)
+		return;
+
+	m_blockSize += SMOOTHING * (BLOCK_PER_CELL * cellSize - m_blockSize);
+	int blockSize = toBlockSize(m_blockSize);
+
+	// Local contrast around the grid: how far the pixels are from the mean the threshold compares them to
+	cv::Rect roi = cv::boundingRect(quad) & cv::Rect(0, 0, gray.cols, gray.rows);
+	if (roi.width > blockSize && roi.height > blockSize)
+	{
+		cv::Mat localMean, deviation;
+		cv::boxFilter(gray(roi), localMean, -1, cv::Size(blockSize, blockSize));
+		cv::absdiff(gray(roi), localMean, deviation);
+
+		m_c += SMOOTHING * (C_PER_DEVIATION * cv::mean(deviation)[0] - m_c);
+	}
+
+	m_params.blockSize = blockSize;
+	m_params.c = std::min(MAX_C, std::max(MIN_C, cvRound(m_c)));
+}
+
+void ThresholdController::candidates(std::vector<ThresholdParams>& out) const
+{
+	out.clear();
+
+	// Same scale, different contrast (lighting changed)
+	ThresholdParams params = m_params;
+	params.c = std::max(MIN_C, m_params.c / 2);
+	if (params.c != m_params.c)
+		out.push_back(params);
+	params.c = std::min(MAX_C, m_params.c * 2);
+	if (params.c != m_params.c)
+		out.push_back(params);
+
+	// Different scale (the grid moved closer or further), the closest to the current one first
+	std::vector<int> blockSizes(CANDIDATE_BLOCK_SIZES, CANDIDATE_BLOCK_SIZES + sizeof(CANDIDATE_BLOCK_SIZES) / sizeof(int));
+	double current = log((double)m_params.blockSize);
+	std::sort(blockSizes.begin(), blockSizes.end(), [current](int a, int b) {
+		return fabs(log((double)a) - current) < fabs(log((double)b) - current);
+	});
+
+	params.c = m_params.c;
+	for (size_t i = 0; i < blockSizes.size() && (int)out.size() < MAX_CANDIDATES; i++)
+	{
+		if (blockSizes[i] == m_params.blockSize)
+			continue;
+		params.blockSize = blockSizes[i];
+		out.push_back(params);
+	}
+}
+
+void ThresholdController::apply(const cv::Mat& gray, const ThresholdParams& params, cv::Mat& binary)
+{
+	cv::adaptiveThreshold(gray, binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, CV_THRESH_BINARY, params.blockSize, params.c);
+	cv::bitwise_not(binary, binary);
+}
+
+int ThresholdController::toBlockSize(double size)
+{
+	int blockSize = cvRound(size) | 1;
+	return std::min(MAX_BLOCK_SIZE, std::max(MIN_BLOCK_SIZE, blockSize));
+}
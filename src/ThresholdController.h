@@ -0,0 +1,63 @@
+/**
+	ThresholdController.h
+	Purpose:	* Chooses the parameters of the adaptive threshold for every frame.
+				The block size follows the size of the cells of the last grid that
+				was found and C follows the local contrast around it, so the grid
+				keeps being found whatever its distance to the camera.
+				* When the grid is lost, it proposes a small set of alternative
+				settings to try (in parallel) on the same frame.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef ThresholdController_H_
+#define ThresholdController_H_
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+typedef struct
+{
+	int blockSize;	// odd, >= 3
+	int c;			// subtracted from the local mean
+} ThresholdParams;
+
+class ThresholdController
+{
+public:
+	ThresholdController(int blockSize, int c);
+
+	const ThresholdParams& params() const { return m_params; }
+
+	// Jumps to 'params', e.g. the candidate that found the grid
+	void setParams(const ThresholdParams& params);
+
+	/**
+	* Adapts the parameters to the grid found in 'gray'
+	* @param corners the 4 corners of the grid in the frame
+	*/
+	void update(const cv::Mat& gray, const cv::Point2f corners[4]);
+
+	/**
+	* Alternative settings to try when the grid is lost, closest to the current ones
+	* first. The current settings are not part of them
+	*/
+	void candidates(std::vector<ThresholdParams>& out) const;
+
+	// Inverted mean adaptive threshold: lines and digits become white
+	static void apply(const cv::Mat& gray, const ThresholdParams& params, cv::Mat& binary);
+
+private:
+	static int toBlockSize(double size);
+
+	ThresholdParams m_params;
+
+	// Smoothed values, rounded into m_params
+	double m_blockSize;
+	double m_c;
+};
+
+#endif // !ThresholdController_H_
@@ -0,0 +1,226 @@
+/**
+	WarpCache.cpp
+	Purpose:	* Implements the cache of the grid projection and of the remap
+				tables that straighten the grid.
+
+	@version 1.0
+*/
+
+#include "stdafx.h"
+#include "WarpCache.h"
+#include "CellExtractor.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <chrono>
+#include <vector>
+
+WarpCache::WarpCache(float tolerance) :
+	m_tolerance(tolerance)
+	, m_hasProjection(false)
+	, m_projWidth(0)
+	, m_projHeight(0)
+	, m_hasLattice(false)
+	, m_hasTileProjections(false)
+	, m_isTileMesh(false)
+	, m_tileMargin(0)
+{
+}
+
+WarpCache::~WarpCache()
+{
+	// Do not leave the worker behind with a dangling cache
+	if (m_pending.valid())
+		m_pending.wait();
+}
+
+bool WarpCache::findProjection(const cv::Point2f corners[4], cv::Mat& projMat, cv::Mat& projMatInv,
+	int& width, int& height) const
+{
+	if (!m_hasProjection || !isClose(m_projCorners, corners))
+		return false;
+
+	projMat = m_projMat;
+	projMatInv = m_projMatInv;
+	width = m_projWidth;
+	height = m_projHeight;
+	return true;
+}
+
+void WarpCache::storeProjection(const cv::Point2f corners[4], const cv::Mat& projMat, const cv::Mat& projMatInv,
+	int width, int height)
+{
+	for (int i = 0; i < 4; i++)
+		m_projCorners[i] = corners[i];
+
+	// Copies, the caller may modify its matrices afterwards (e.g. the lattice refit)
+	m_projMat = projMat.clone();
+	m_projMatInv = projMatInv.clone();
+	m_projWidth = width;
+	m_projHeight = height;
+	m_hasProjection = true;
+}
+
+bool WarpCache::findLattice(cv::Point2f lattice[100], int width, int height, cv::Mat& projMat, cv::Mat& projMatInv) const
+{
+	if (!m_hasLattice || m_latticeGridSize != cv::Size(width, height))
+		return false;
+
+	float tolerance2 = m_tolerance * m_tolerance;
+	for (int i = 0; i < 100; i++)
+	{
+		cv::Point2f d = lattice[i] - m_lattice[i];
+		if (d.x * d.x + d.y * d.y > tolerance2)
+			return false;
+	}
+
+	for (int i = 0; i < 100; i++)
+		lattice[i] = m_lattice[i];
+	projMat = m_latticeProjMat;
+	projMatInv = m_latticeProjMatInv;
+	return true;
+}
+
+void WarpCache::storeLattice(const cv::Point2f lattice[100], int width, int height, const cv::Mat& projMat, const cv::Mat& projMatInv)
+{
+	for (int i = 0; i < 100; i++)
+		m_lattice[i] = lattice[i];
+	m_latticeGridSize = cv::Size(width, height);
+	m_latticeProjMat = projMat.clone();
+	m_latticeProjMatInv = projMatInv.clone();
+	m_hasLattice = true;
+}
+
+const cv::Matx33d* WarpCache::tileProjections(const cv::Mat& projMatInv, int width, int height, const cv::Point2f* lattice,
+	double margin)
+{
+	// The same inputs exactly: those of the cached projection or lattice, snapped while the grid stays put
+	bool isCached = m_hasTileProjections && m_isTileMesh == (lattice != NULL) && m_tileMargin == margin;
+	if (isCached && lattice)
+	{
+		for (int i = 0; isCached && i < 100; i++)
+			isCached = lattice[i] == m_tileLattice[i];
+	}
+	else if (isCached)
+	{
+		isCached = m_tileGridSize == cv::Size(width, height) && m_tileProjMatInv.size() == projMatInv.size()
+			&& m_tileProjMatInv.type() == projMatInv.type() && cv::norm(m_tileProjMatInv, projMatInv, cv::NORM_INF) == 0;
+	}
+	if (isCached)
+		return m_tileToFrame;
+
+	if (lattice)
+	{
+		CellExtractor::cellProjections(lattice, margin, m_tileToFrame);
+		for (int i = 0; i < 100; i++)
+			m_tileLattice[i] = lattice[i];
+	}
+	else
+	{
+		CellExtractor::cellProjections(projMatInv, width, height, margin, m_tileToFrame);
+		m_tileProjMatInv = projMatInv.clone();
+		m_tileGridSize = cv::Size(width, height);
+	}
+	m_isTileMesh = lattice != NULL;
+	m_tileMargin = margin;
+	m_hasTileProjections = true;
+	return m_tileToFrame;
+}
+
+bool WarpCache::warp(const cv::Mat& src, const cv::Mat& projMatInv, int width, int height, cv::Mat& dst)
+{
+	cv::Size size(width, height);
+
+	cv::Point2f corners[4];
+	gridCorners(projMatInv, size, corners);
+
+	// Pick up the tables of the worker as soon as they are ready
+	if (m_pending.valid() && m_pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		m_tables = m_pending.get();
+
+	if (m_tables && m_tables->size == size && isClose(m_tables->corners, corners))
+	{
+		cv::remap(src, dst, m_tables->map1, m_tables->map2, cv::INTER_LINEAR);
+		return true;
+	}
+
+	// The grid moved: build the tables for where it is now, at most one build at a time.
+	// If it keeps moving, the next build starts once this one is done
+	if (!m_pending.valid())
+		m_pending = std::async(std::launch::async, buildTables, projMatInv.clone(), size);
+
+	cv::warpPerspective(src, dst, projMatInv, size, cv::INTER_LINEAR | cv::WARP_INVERSE_MAP);
+	return false;
+}
+
+/**
+* Evaluates the projection for every pixel of the straightened grid (incrementally
+* along the rows) and packs the result into the fixed-point format of cv::remap
+*/
+std::shared_ptr<WarpCache::WarpTables> WarpCache::buildTables(cv::Mat projMatInv, cv::Size size)
+{
+	std::shared_ptr<WarpTables> tables = std::make_shared<WarpTables>();
+	tables->size = size;
+	gridCorners(projMatInv, size, tables->corners);
+
+	cv::Mat mapX(size, CV_32FC1), mapY(size, CV_32FC1);
+
+	cv::Mat h64;
+	projMatInv.convertTo(h64, CV_64F);
+	const double* h = h64.ptr<double>();
+
+	for (int v = 0; v < size.height; v++)
+	{
+		float* xRow = mapX.ptr<float>(v);
+		float* yRow = mapY.ptr<float>(v);
+
+		double X = h[1] * v + h[2];
+		double Y = h[4] * v + h[5];
+		double W = h[7] * v + h[8];
+
+		for (int u = 0; u < size.width; u++)
+		{
+			double w = (W != 0) ? 1.0 / W : 0.0;
+			xRow[u] = (float)(X * w);
+			yRow[u] = (float)(Y * w);
+
+			X += h[0];
+			Y += h[3];
+			W += h[6];
+		}
+	}
+
+	cv::convertMaps(mapX, mapY, tables->map1, tables->map2, CV_16SC2);
+
+	return tables;
+}
+
+/**
+* Frame location of the corners of the straightened grid, in the corner order of
+* SudokuAR (top-left, bottom-left, bottom-right, top-right)
+*/
+void WarpCache::gridCorners(const cv::Mat& projMatInv, cv::Size size, cv::Point2f corners[4])
+{
+	std::vector<cv::Point2f> points(4);
+	points[0] = cv::Point2f(0, 0);
+	points[1] = cv::Point2f(0, (float)(size.height - 1));
+	points[2] = cv::Point2f((float)(size.width - 1), (float)(size.height - 1));
+	points[3] = cv::Point2f((float)(size.width - 1), 0);
+
+	cv::perspectiveTransform(points, points, projMatInv);
+
+	for (int i = 0; i < 4; i++)
+		corners[i] = points[i];
+}
+
+bool WarpCache::isClose(const cv::Point2f a[4], const cv::Point2f b[4]) const
+{
+	float tolerance2 = m_tolerance * m_tolerance;
+	for (int i = 0; i < 4; i++)
+	{
+		cv::Point2f d = a[i] - b[i];
+		if (d.x * d.x + d.y * d.y > tolerance2)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+/**
+	WarpCache.h
+	Purpose:	* Keeps the projection of the grid and the fixed-point remap tables
+				that straighten it, for as long as the grid stays put. While the
+				corners move less than a subpixel tolerance, straightening the grid
+				is a single table-driven cv::remap.
+				* When the grid moves, the tables are rebuilt on a worker thread
+				and the frame falls back to cv::warpPerspective meanwhile.
+				* The 100 lattice crossings are held to the same tolerance: while
+				they stay put, they are snapped to the stored ones, and the
+				projections of the 81 tiles are not computed again.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef WarpCache_H_
+#define WarpCache_H_
+
+#include "opencv2/core.hpp"
+
+#include <future>
+#include <memory>
+
+class WarpCache
+{
+public:
+	/**
+	* @param tolerance largest corner shift (in pixels) for which cached data is reused
+	*/
+	WarpCache(float tolerance);
+	~WarpCache();
+
+	/**
+	* Looks up the projection of the grid whose corners are 'corners'
+	* @return true if the corners moved less than the tolerance since the projection was stored
+	*/
+	bool findProjection(const cv::Point2f corners[4], cv::Mat& projMat, cv::Mat& projMatInv,
+		int& width, int& height) const;
+
+	void storeProjection(const cv::Point2f corners[4], const cv::Mat& projMat, const cv::Mat& projMatInv,
+		int width, int height);
+
+	/**
+	* Looks up the lattice of the grid, straightened to width x height. If none of the crossings
+	* moved more than the tolerance since the lattice was stored, 'lattice' is snapped to the stored one
+	* @return true if so, with the projection fitted to the stored lattice
+	*/
+	bool findLattice(cv::Point2f lattice[100], int width, int height, cv::Mat& projMat, cv::Mat& projMatInv) const;
+
+	void storeLattice(const cv::Point2f lattice[100], int width, int height, const cv::Mat& projMat, const cv::Mat& projMatInv);
+
+	/**
+	* Projections from the tiles of the 81 cells to the frame, as CellExtractor::cellProjections
+	* gives them: through the crossings of 'lattice' if not NULL, or else through 'projMatInv'.
+	* They are only computed again when the projection or the lattice is not the last one
+	*/
+	const cv::Matx33d* tileProjections(const cv::Mat& projMatInv, int width, int height, const cv::Point2f* lattice,
+		double margin);
+
+	/**
+	* Straightens the grid: dst(u, v) = src(projMatInv * (u, v)), dst being width x height
+	* @return true if the cached tables were used
+	*/
+	bool warp(const cv::Mat& src, const cv::Mat& projMatInv, int width, int height, cv::Mat& dst);
+
+private:
+	typedef struct
+	{
+		cv::Point2f corners[4];	// frame location of the grid corners the tables were built for
+		cv::Size size;
+		cv::Mat map1, map2;		// CV_16SC2 / CV_16UC1 tables of cv::convertMaps
+	} WarpTables;
+
+	static std::shared_ptr<WarpTables> buildTables(cv::Mat projMatInv, cv::Size size);
+	static void gridCorners(const cv::Mat& projMatInv, cv::Size size, cv::Point2f corners[4]);
+	bool isClose(const cv::Point2f a[4], const cv::Point2f b[4]) const;
+
+	float m_tolerance;
+
+	bool m_hasProjection;
+	cv::Point2f m_projCorners[4];
+	cv::Mat m_projMat, m_projMatInv;
+	int m_projWidth, m_projHeight;
+
+	bool m_hasLattice;
+	cv::Point2f m_lattice[100];
+	cv::Size m_latticeGridSize;
+	cv::Mat m_latticeProjMat, m_latticeProjMatInv;
+
+	bool m_hasTileProjections;
+	cv::Matx33d m_tileToFrame[81];
+	cv::Mat m_tileProjMatInv; // Inputs the tile projections were computed from
+	cv::Size m_tileGridSize;
+	bool m_isTileMesh;
+	cv::Point2f m_tileLattice[100];
+	double m_tileMargin;
+
+	std::shared_ptr<WarpTables> m_tables;
+	std::future<std::shared_ptr<WarpTables>> m_pending;
+};
+
+#endif // !WarpCache_H_
@@ -0,0 +1,141 @@
+/**
+	benchmark_batching.cpp
+	Purpose:	* Runs several streams at once, each classifying the 81 cells of its
+				frames, once with a DigitCnn of its own and once through a shared
+				BatchScheduler: throughput, latency of a frame and size of the
+				batches.
+				* Usage: benchmark_batching [model file] [streams] [window ms]
+				The cells are random strokes, about half of them blank (skipped).
+
+	@version 1.0
+*/
+
+#include "BatchScheduler.h"
+#include "CellExtractor.h"
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const int CELLS = 81;
+	const int FRAMES = 200;
+	const int MAX_BATCH_TILES = 4 * CELLS;
+
+	double elapsedMs(int64 start)
+	{
+		return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+	}
+
+	// A few dark strokes on white in half of the cells, the others are skipped
+	void randomCells(unsigned int seed, std::vector<unsigned char>& tiles, bool skip[CELLS])
+	{
+		std::mt19937 random(seed);
+		std::uniform_int_distribution<int> coord(4, CELL_SIZE - 5);
+		tiles.assign((size_t)CELLS * CELL_PIXELS, 255);
+		for (int t = 0; t < CELLS; t++)
+		{
+			skip[t] = random() % 2 == 0;
+			cv::Mat tile(CELL_SIZE, CELL_SIZE, CV_8U, &tiles[(size_t)t * CELL_PIXELS]);
+			for (int s = 0; s < 3; s++)
+				cv::line(tile, cv::Point(coord(random), coord(random)), cv::Point(coord(random), coord(random)), cv::Scalar(0), 2);
+		}
+	}
+
+	// Every stream classifies FRAMES frames with its classifier. Returns the latencies of all frames,
+	// and in 'sentTiles' the number of tiles that were not skipped
+	std::vector<double> runStreams(std::vector<std::unique_ptr<DigitClassifier>>& classifiers, double& totalMs, long long& sentTiles)
+	{
+		int streams = (int)classifiers.size();
+		std::vector<double> latencies((size_t)streams * FRAMES);
+		std::vector<int> streamTiles(streams, 0);
+
+		int64 start = cv::getTickCount();
+		std::vector<std::thread> threads;
+		for (int s = 0; s < streams; s++)
+		{
+			threads.push_back(std::thread([&, s] {
+				std::vector<unsigned char> tiles;
+				bool skip[CELLS];
+				randomCells(s + 1, tiles, skip);
+				streamTiles[s] = (int)std::count(skip, skip + CELLS, false);
+				int digits[CELLS];
+				for (int f = 0; f < FRAMES; f++)
+				{
+					int64 frameStart = cv::getTickCount();
+					classifiers[s]->predict(&tiles[0], skip, CELLS, digits);
+					latencies[(size_t)s * FRAMES + f] = elapsedMs(frameStart);
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		totalMs = elapsedMs(start);
+
+		sentTiles = 0;
+		for (int s = 0; s < streams; s++)
+			sentTiles += (long long)streamTiles[s] * FRAMES;
+
+		std::sort(latencies.begin(), latencies.end());
+		return latencies;
+	}
+
+	void printRow(const char* mode, const std::vector<double>& latencies, double totalMs, double tilesPerBatch)
+	{
+		double p50 = latencies[latencies.size() / 2];
+		double p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+		printf("%-10s %12.1f %10.2f %10.2f %12.1f\n", mode, latencies.size() * 1000.0 / totalMs, p50, p99, tilesPerBatch);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string modelPath = argc > 1 ? argv[1] : DigitClassifier::defaultModelPath(DIGIT_BACKEND_CNN);
+	int streams = argc > 2 ? atoi(argv[2]) : 4;
+	double windowMs = argc > 3 ? atof(argv[3]) : 2.0;
+
+	std::cout << streams << " streams of " << FRAMES << " frames, " << modelPath << std::endl;
+	printf("%-10s %12s %10s %10s %12s\n", "mode", "frames / s", "p50 ms", "p99 ms", "tiles/batch");
+
+	// Every stream with a classifier of its own
+	std::vector<std::unique_ptr<DigitClassifier>> classifiers;
+	for (int s = 0; s < streams; s++)
+	{
+		classifiers.push_back(DigitClassifier::create(DIGIT_BACKEND_CNN));
+		if (!classifiers.back()->load(modelPath))
+		{
+			std::cout << "Can't read " << modelPath << std::endl;
+			return 1;
+		}
+	}
+	double totalMs;
+	long long sentTiles;
+	std::vector<double> latencies = runStreams(classifiers, totalMs, sentTiles);
+	printRow("direct", latencies, totalMs, (double)sentTiles / latencies.size()); // every frame is a batch of its own
+
+	// All the streams through one scheduler
+	std::unique_ptr<DigitClassifier> shared = DigitClassifier::create(DIGIT_BACKEND_CNN);
+	shared->load(modelPath);
+	BatchScheduler scheduler(std::move(shared), windowMs, MAX_BATCH_TILES);
+	classifiers.clear();
+	for (int s = 0; s < streams; s++)
+		classifiers.push_back(scheduler.createClient());
+	latencies = runStreams(classifiers, totalMs, sentTiles);
+	classifiers.clear();
+
+	BatchStats stats = scheduler.stats();
+	printRow("batched", latencies, totalMs, (double)stats.tiles / std::max(1LL, stats.batches));
+	printf("%lld batches, %.2f ms waiting and %.2f ms classifying per batch\n", stats.batches,
+		stats.waitMs / std::max(1LL, stats.batches), stats.inferenceMs / std::max(1LL, stats.batches));
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/**
+	benchmark_classifiers.cpp
+	Purpose:	* Compares the DigitClassifier backends on a labeled image set:
+				time of a batch of 81 cells and share of the digits recognized.
+				* Usage: benchmark_classifiers [digit list | labeled folder] [backend=model ...]
+				By default the digits held out of training by scripts/train_hog.py
+				(trained_net/digit_validation.txt, "<path> <digit>" per line). A
+				folder holds one subfolder of PNGs per digit, like
+				scripts/cnn_train_digits, which the models were trained on: its
+				accuracy is not a measure of generalization. Backends are cnn, dnn,
+				hog, student and remote; those not named read their default model.
+
+	@version 1.0
+*/
+
+#include "DigitClassifier.h"
+#include "CellExtractor.h"
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const int BATCH = 81;
+	const int PER_CLASS = 200;
+	const int CLASSES = 10;
+
+	const char* BACKEND_KEYS[NUM_DIGIT_BACKENDS] = { "cnn", "dnn", "hog", "student", "remote" };
+
+	double elapsedMs(int64 start)
+	{
+		return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+	}
+
+	// Appends the image at 'path', resized to CELL_SIZE, to the tiles
+	void addTile(const std::string& path, int digit, std::vector<unsigned char>& tiles, std::vector<int>& labels)
+	{
+		cv::Mat image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+		if (image.empty())
+			return;
+		tiles.resize(tiles.size() + CELL_PIXELS);
+		cv::Mat tile(CELL_SIZE, CELL_SIZE, CV_8U, &tiles[tiles.size() - CELL_PIXELS]);
+		cv::resize(image, tile, tile.size(), 0, 0, cv::INTER_AREA);
+		labels.push_back(digit);
+	}
+
+	// Up to PER_CLASS tiles of every digit of a labeled folder, one after the other
+	int loadLabeledFolder(const std::string& folder, std::vector<unsigned char>& tiles, std::vector<int>& labels)
+	{
+		for (int digit = 0; digit < CLASSES; digit++)
+		{
+			std::vector<cv::String> files;
+			cv::glob(folder + "/" + std::to_string(digit) + "/*.png", files);
+			for (size_t i = 0; i < files.size() && (int)i < PER_CLASS; i++)
+				addTile(files[i], digit, tiles, labels);
+		}
+		return (int)labels.size();
+	}
+
+	// Every digit of a list of train_hog.py, paths being relative to the list
+	int loadDigitList(const std::string& listPath, std::vector<unsigned char>& tiles, std::vector<int>& labels)
+	{
+		std::ifstream list(listPath);
+		size_t slash = listPath.find_last_of("/\\");
+		std::string folder = slash == std::string::npos ? "." : listPath.substr(0, slash);
+
+		std::string path;
+		int digit;
+		while (list >> path >> digit)
+		{
+			if (digit >= 0 && digit < CLASSES)
+				addTile(folder + "/" + path, digit, tiles, labels);
+		}
+		return (int)labels.size();
+	}
+
+	bool isDigitList(const std::string& path)
+	{
+		return path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string digitSet = argc > 1 ? argv[1] : "./scripts/trained_net/digit_validation.txt";
+
+	std::string modelPaths[NUM_DIGIT_BACKENDS];
+	for (int b = 0; b < NUM_DIGIT_BACKENDS; b++)
+		modelPaths[b] = DigitClassifier::defaultModelPath((DigitBackend)b);
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		size_t equals = arg.find('=');
+		for (int b = 0; b < NUM_DIGIT_BACKENDS && equals != std::string::npos; b++)
+		{
+			if (arg.compare(0, equals, BACKEND_KEYS[b]) == 0)
+				modelPaths[b] = arg.substr(equals + 1);
+		}
+	}
+
+	std::vector<unsigned char> tiles;
+	std::vector<int> labels;
+	bool isHeldOut = isDigitList(digitSet);
+	int count = isHeldOut ? loadDigitList(digitSet, tiles, labels) : loadLabeledFolder(digitSet, tiles, labels);
+	if (count == 0)
+	{
+		std::cout << "No labeled digits in " << digitSet << (isHeldOut ? " (run scripts/train_hog.py to write it)" : "") << std::endl;
+		return 1;
+	}
+	if (isHeldOut)
+		std::cout << count << " held-out digits of " << digitSet << std::endl;
+	else
+		std::cout << count << " digits of the labeled folder " << digitSet << ", not held out: the models may have been trained on them" << std::endl;
+
+	printf("%-10s %12s %10s  %s\n", "backend", "ms / 81", "accuracy", "model");
+	std::vector<int> digits(count);
+	for (int b = 0; b < NUM_DIGIT_BACKENDS; b++)
+	{
+		DigitBackend backend = (DigitBackend)b;
+		std::unique_ptr<DigitClassifier> classifier = DigitClassifier::create(backend);
+		if (!classifier->load(modelPaths[b]))
+		{
+			printf("%-10s %12s %10s  %s\n", DigitClassifier::backendName(backend), "-", "-", modelPaths[b].c_str());
+			continue;
+		}
+
+		// Warm up on the first batch, then time every full batch of 81 cells
+		classifier->predict(&tiles[0], NULL, std::min(BATCH, count), &digits[0]);
+		int64 start = cv::getTickCount();
+		int batches = 0;
+		for (int first = 0; first < count; first += BATCH, batches++)
+			classifier->predict(&tiles[(size_t)first * CELL_PIXELS], NULL, std::min(BATCH, count - first), &digits[first]);
+		double ms = elapsedMs(start) / batches;
+
+		int correct = 0;
+		for (int t = 0; t < count; t++)
+		{
+			if (digits[t] == labels[t])
+				correct++;
+		}
+		printf("%-10s %12.2f %9.2f%%  %s\n", DigitClassifier::backendName(backend), ms, 100.0 * correct / count, modelPaths[b].c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+/**
+	benchmark_cnn.cpp
+	Purpose:	* Times DigitCnn on a batch of 81 cells against a naive im2col + GEMM
+				forward pass of the same weights, and checks that both give the
+				same digits and probabilities.
+				* Usage: benchmark_cnn [model file] [folder of 28 x 28 PNG cells] [threads]
+				Without a float model file, the weights are random; without
+				enough cells, the batch is filled with random strokes. DigitCnn
+				runs on 1 thread unless told otherwise, like the baseline.
+
+	@version 1.0
+*/
+
+#include "DigitCnn.h"
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+	const int CELLS = 81;
+	const int REPETITIONS = 20;
+
+	const int KERNEL = 3;
+
+	double elapsedMs(int64 start)
+	{
+		return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+	}
+
+	// out (rows x cols) = a (rows x depth) * b (depth x cols)
+	void gemm(const float* a, const float* b, int rows, int depth, int cols, float* out)
+	{
+		for (int i = 0; i < rows; i++)
+		{
+			float* o = out + (size_t)i * cols;
+			std::fill(o, o + cols, 0.0f);
+			for (int k = 0; k < depth; k++)
+			{
+				float x = a[(size_t)i * depth + k];
+				const float* w = b + (size_t)k * cols;
+				for (int j = 0; j < cols; j++)
+					o[j] += x * w[j];
+			}
+		}
+	}
+
+	// Valid 3 x 3 convolution + ReLU of an HWC image, through im2col: one row of 3 x 3 x channels inputs per output pixel
+	void convolve(const std::vector<float>& in, int size, int channels, const float* kernel, const float* bias, int outChannels,
+		std::vector<float>& columns, std::vector<float>& out)
+	{
+		int outSize = size - KERNEL + 1;
+		int depth = KERNEL * KERNEL * channels;
+		columns.resize((size_t)outSize * outSize * depth);
+		out.resize((size_t)outSize * outSize * outChannels);
+
+		for (int y = 0; y < outSize; y++)
+		{
+			for (int x = 0; x < outSize; x++)
+			{
+				float* row = &columns[((size_t)y * outSize + x) * depth];
+				for (int ky = 0; ky < KERNEL; ky++)
+					for (int kx = 0; kx < KERNEL; kx++)
+						for (int c = 0; c < channels; c++)
+							*row++ = in[((size_t)(y + ky) * size + x + kx) * channels + c];
+			}
+		}
+
+		gemm(&columns[0], kernel, outSize * outSize, depth, outChannels, &out[0]);
+		for (size_t i = 0; i < out.size(); i++)
+			out[i] = std::max(0.0f, out[i] + bias[i % outChannels]);
+	}
+
+	// The whole network on one tile, layer by layer, every intermediate in memory
+	void baselinePredict(const DigitCnnWeights& w, const unsigned char* tile, float probabilities[DIGIT_CLASSES])
+	{
+		std::vector<float> input(CELL_PIXELS), columns, conv1, conv2;
+		for (int i = 0; i < CELL_PIXELS; i++)
+			input[i] = tile[i] > INPUT_THRESHOLD ? 0.0f : 1.0f;
+
+		convolve(input, CELL_SIZE, 1, w.conv1Kernel, w.conv1Bias, 32, columns, conv1);
+		convolve(conv1, CELL_SIZE - 2, 32, w.conv2Kernel, w.conv2Bias, 64, columns, conv2);
+
+		const int convSize = CELL_SIZE - 4, poolSize = convSize / 2;
+		std::vector<float> features((size_t)poolSize * poolSize * 64);
+		for (int y = 0; y < poolSize; y++)
+		{
+			for (int x = 0; x < poolSize; x++)
+			{
+				for (int c = 0; c < 64; c++)
+				{
+					const float* p = &conv2[((size_t)(2 * y) * convSize + 2 * x) * 64 + c];
+					features[((size_t)y * poolSize + x) * 64 + c] =
+						std::max(std::max(p[0], p[64]), std::max(p[convSize * 64], p[convSize * 64 + 64]));
+				}
+			}
+		}
+
+		float hidden[128], logits[DIGIT_CLASSES];
+		gemm(&features[0], w.dense1Kernel, 1, (int)features.size(), 128, hidden);
+		for (int j = 0; j < 128; j++)
+			hidden[j] = std::max(0.0f, hidden[j] + w.dense1Bias[j]);
+		gemm(hidden, w.dense2Kernel, 1, 128, DIGIT_CLASSES, logits);
+
+		float maxLogit = -1e30f, sum = 0;
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			maxLogit = std::max(maxLogit, logits[c] + w.dense2Bias[c]);
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			sum += probabilities[c] = expf(logits[c] + w.dense2Bias[c] - maxLogit);
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			probabilities[c] /= sum;
+	}
+
+	// Up to CELLS tiles from the PNGs of 'folder', the rest random strokes
+	void loadTiles(const std::string& folder, std::vector<unsigned char>& tiles, std::mt19937& random)
+	{
+		tiles.assign((size_t)CELLS * CELL_PIXELS, 255);
+
+		std::vector<cv::String> files;
+		if (!folder.empty())
+			cv::glob(folder + "/*.png", files);
+
+		int loaded = 0;
+		for (size_t i = 0; i < files.size() && loaded < CELLS; i++)
+		{
+			cv::Mat image = cv::imread(files[i], cv::IMREAD_GRAYSCALE);
+			if (image.empty())
+				continue;
+			cv::Mat tile(CELL_SIZE, CELL_SIZE, CV_8U, &tiles[(size_t)loaded * CELL_PIXELS]);
+			cv::resize(image, tile, tile.size(), 0, 0, cv::INTER_AREA);
+			loaded++;
+		}
+		std::cout << "Cells: " << loaded << " from " << (folder.empty() ? "nowhere" : folder) << ", " << CELLS - loaded << " random" << std::endl;
+
+		for (int t = loaded; t < CELLS; t++)
+		{
+			cv::Mat tile(CELL_SIZE, CELL_SIZE, CV_8U, &tiles[(size_t)t * CELL_PIXELS]);
+			for (int s = 0; s < 3; s++)
+			{
+				cv::Point a(4 + random() % 20, 4 + random() % 20), b(4 + random() % 20, 4 + random() % 20);
+				cv::line(tile, a, b, cv::Scalar(0), 2);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string modelPath = argc > 1 ? argv[1] : "./scripts/trained_net/digit_cnn.model";
+	std::string cellFolder = argc > 2 ? argv[2] : "./scripts/extracted_numbers/gray";
+	int threads = argc > 3 ? std::max(1, atoi(argv[3])) : 1;
+
+	// DigitCnn::predict spreads the cells over cv::parallel_for_
+	cv::setNumThreads(threads);
+
+	std::mt19937 random(1);
+	std::vector<float> parameters;
+
+	DigitCnn cnn;
+	if (!cnn.load(modelPath) || cnn.isQuantized())
+	{
+		// The fused kernels are the float path: random float weights, the scale of a trained network
+		std::cout << "No float model at " << modelPath << ", using random weights" << std::endl;
+		std::normal_distribution<float> normal(0.0f, 0.05f);
+		parameters.resize(DigitCnn::parameterCount());
+		for (size_t i = 0; i < parameters.size(); i++)
+			parameters[i] = normal(random);
+
+		DigitCnnWeights w;
+		const float* p = &parameters[0];
+		w.conv1Kernel = p;	p += KERNEL * KERNEL * 32;
+		w.conv1Bias = p;	p += 32;
+		w.conv2Kernel = p;	p += KERNEL * KERNEL * 32 * 64;
+		w.conv2Bias = p;	p += 64;
+		w.dense1Kernel = p;	p += 12 * 12 * 64 * 128;
+		w.dense1Bias = p;	p += 128;
+		w.dense2Kernel = p;	p += 128 * DIGIT_CLASSES;
+		w.dense2Bias = p;
+		cnn.setWeights(w);
+	}
+
+	std::vector<unsigned char> tiles;
+	loadTiles(cellFolder, tiles, random);
+
+	// Baseline, one pass is enough to time it
+	std::vector<float> expected((size_t)CELLS * DIGIT_CLASSES);
+	int64 start = cv::getTickCount();
+	for (int t = 0; t < CELLS; t++)
+		baselinePredict(cnn.weights(), &tiles[(size_t)t * CELL_PIXELS], &expected[(size_t)t * DIGIT_CLASSES]);
+	double baselineMs = elapsedMs(start);
+
+	int digits[CELLS];
+	float confidences[CELLS];
+	double bestMs = 1e30, totalMs = 0;
+	for (int r = 0; r < REPETITIONS; r++)
+	{
+		start = cv::getTickCount();
+		cnn.predict(&tiles[0], NULL, CELLS, digits, confidences);
+		double ms = elapsedMs(start);
+		bestMs = std::min(bestMs, ms);
+		totalMs += ms;
+	}
+
+	int mismatches = 0;
+	double maxDifference = 0;
+	for (int t = 0; t < CELLS; t++)
+	{
+		const float* p = &expected[(size_t)t * DIGIT_CLASSES];
+		int digit = (int)(std::max_element(p, p + DIGIT_CLASSES) - p);
+		if (digit != digits[t])
+			mismatches++;
+		maxDifference = std::max(maxDifference, (double)fabs(p[digit] - confidences[t]));
+	}
+
+	printf("im2col + GEMM baseline: %8.2f ms / %d cells\n", baselineMs, CELLS);
+	printf("DigitCnn, fused fp32:   %8.2f ms best, %.2f ms mean, %d thread(s)\n", bestMs, totalMs / REPETITIONS, threads);
+	printf("Speedup: %.1fx, digits that differ: %d, largest probability difference: %g\n", baselineMs / bestMs, mismatches, maxDifference);
+
+	return mismatches == 0 ? 0 : 1;
+}
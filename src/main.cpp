@@ -34,6 +34,7 @@
 #include "DrawPrimitives.h"
 #include "PoseEstimation.h"
 #include "SudokuAR.h"
+#include "SudokuViewer.h"
 
 using namespace std;
 cv::VideoCapture cap;
@@ -245,7 +246,12 @@ int main()
 	cv::Mat img_bgr;
 	initVideoStream(cap);
 	
-	SudokuAR sudokuAR(sudokuSize);
+	// The viewer shows the straightened grid
+	SudokuConfig config = SudokuAR::defaultConfig(sudokuSize);
+	config.renderGridImage = true;
+	SudokuAR sudokuAR(config);
+	SudokuViewer viewer(sudokuAR.getConfig());
+	SudokuResult result;
 
 	// initialize the window system
 	/* Create a windowed mode window and its OpenGL context */
@@ -287,7 +293,11 @@ int main()
 		}
 
 		/* Track a marker */
-		if (!sudokuAR.processNextFrame(img_bgr, resultMatrix)) {
+		sudokuAR.processFrame(img_bgr, result);
+		if (result.hasPose)
+			std::copy(result.pose, result.pose + 16, resultMatrix);
+
+		if (!viewer.show(result, sudokuAR)) {
 			return 0;
 		}
 
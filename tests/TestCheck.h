@@ -0,0 +1,30 @@
+/**
+	TestCheck.h
+	Purpose:	* Checks of the unit tests in tests/, one executable per test run
+				by ctest: a failed CHECK prints where it failed and the test
+				returns 1 at the end.
+
+	@version 1.0
+*/
+
+#pragma once
+
+#ifndef TestCheck_H_
+#define TestCheck_H_
+
+#include <iostream>
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+			testFailures++; \
+		} \
+	} while (0)
+
+// Exit code of the test
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
+
+#endif // !TestCheck_H_
@@ -0,0 +1,197 @@
+/**
+	test_batch_scheduler.cpp
+	Purpose:	* Unit test of the BatchScheduler: several streams submit at once,
+				every stream gets back the answers of its own tiles, in its order,
+				with -1 for the tiles it skipped, and the classifier is never run
+				by two threads. A classifier that throws leaves no stream waiting.
+
+	@version 1.0
+*/
+
+#include "BatchScheduler.h"
+#include "CellExtractor.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const int STREAMS = 4;
+	const int ROUNDS = 50;
+	const int CELLS = 81;
+
+	// Every tile carries an id in its first two bytes; the "digit" is id % 10 and the confidence the id
+	class EchoClassifier : public DigitClassifier
+	{
+	public:
+		EchoClassifier(std::atomic<int>& running, std::atomic<int>& overlaps) :
+			m_running(running)
+			, m_overlaps(overlaps)
+		{
+		}
+
+		bool load(const std::string& path) override { return true; }
+		bool isLoaded() const override { return true; }
+
+		void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override
+		{
+			if (m_running++ > 0)
+				m_overlaps++;
+			for (int t = 0; t < count; t++)
+			{
+				bool isSkipped = skip && skip[t];
+				int id = tiles[(size_t)t * CELL_PIXELS] * 256 + tiles[(size_t)t * CELL_PIXELS + 1];
+				digits[t] = isSkipped ? -1 : id % 10;
+				if (confidences)
+					confidences[t] = isSkipped ? 0.0f : (float)id;
+			}
+			std::this_thread::yield();
+			m_running--;
+		}
+
+	private:
+		std::atomic<int>& m_running;
+		std::atomic<int>& m_overlaps;
+	};
+
+	// Fails its first 'failures' batches, then answers 5 for every tile
+	class FailingClassifier : public DigitClassifier
+	{
+	public:
+		FailingClassifier(int failures) :
+			m_failures(failures)
+		{
+		}
+
+		bool load(const std::string& path) override { return true; }
+		bool isLoaded() const override { return true; }
+
+		void predict(const unsigned char* tiles, const bool* skip, int count, int* digits, float* confidences = NULL) override
+		{
+			if (m_failures-- > 0)
+				throw std::runtime_error("classifier failed");
+			for (int t = 0; t < count; t++)
+				digits[t] = (skip && skip[t]) ? -1 : 5;
+		}
+
+	private:
+		std::atomic<int> m_failures;
+	};
+
+	// Whether the batch of 'client' failed: its leader gets the exception, the other streams -1
+	bool predictFails(DigitClassifier& client, int* digits)
+	{
+		std::vector<unsigned char> tiles((size_t)2 * CELL_PIXELS, 0);
+		digits[0] = digits[1] = 0;
+		try
+		{
+			client.predict(&tiles[0], NULL, 2, digits);
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return digits[0] == -1 && digits[1] == -1;
+	}
+
+	void testFailingClassifier()
+	{
+		std::unique_ptr<DigitClassifier> classifier(new FailingClassifier(1));
+		BatchScheduler scheduler(std::move(classifier), 50.0, CELLS);
+
+		// Both streams wait for each other, so the failure hits a batch of both
+		std::unique_ptr<DigitClassifier> first = scheduler.createClient();
+		std::unique_ptr<DigitClassifier> second = scheduler.createClient();
+		int firstDigits[2], secondDigits[2];
+		bool isSecondFailed = false;
+		std::thread other([&] { isSecondFailed = predictFails(*second, secondDigits); });
+		bool isFirstFailed = predictFails(*first, firstDigits);
+		other.join();
+		CHECK(isFirstFailed || isSecondFailed);
+
+		// The scheduler has no leader left over: the next batches run
+		second.reset();
+		CHECK(!predictFails(*first, firstDigits));
+		CHECK(firstDigits[0] == 5 && firstDigits[1] == 5);
+		CHECK(scheduler.stats().batches >= 2);
+	}
+
+	int tileId(int stream, int round, int t)
+	{
+		return (stream * ROUNDS + round) * CELLS + t;
+	}
+
+	// Submits ROUNDS grids with a different skip pattern each and checks every answer
+	void runStream(BatchScheduler& scheduler, int stream, std::atomic<int>& wrongAnswers, std::atomic<long long>& sentTiles)
+	{
+		std::unique_ptr<DigitClassifier> client = scheduler.createClient();
+		std::vector<unsigned char> tiles((size_t)CELLS * CELL_PIXELS, 255);
+		bool skip[CELLS];
+		int digits[CELLS];
+		float confidences[CELLS];
+
+		for (int round = 0; round < ROUNDS; round++)
+		{
+			for (int t = 0; t < CELLS; t++)
+			{
+				int id = tileId(stream, round, t);
+				tiles[(size_t)t * CELL_PIXELS] = (unsigned char)(id / 256);
+				tiles[(size_t)t * CELL_PIXELS + 1] = (unsigned char)(id % 256);
+				skip[t] = (t + round + stream) % 3 == 0 || (round % 7 == 6 && stream == 1); // stream 1 skips whole grids
+				if (!skip[t])
+					sentTiles++;
+			}
+
+			client->predict(&tiles[0], skip, CELLS, digits, confidences);
+
+			for (int t = 0; t < CELLS; t++)
+			{
+				int id = tileId(stream, round, t);
+				bool isRight = skip[t] ? digits[t] == -1 && confidences[t] == 0.0f
+					: digits[t] == id % 10 && confidences[t] == (float)id;
+				if (!isRight)
+					wrongAnswers++;
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::atomic<int> running(0), overlaps(0), wrongAnswers(0);
+	std::atomic<long long> sentTiles(0);
+
+	std::unique_ptr<DigitClassifier> classifier(new EchoClassifier(running, overlaps));
+	BatchScheduler scheduler(std::move(classifier), 5.0, STREAMS * CELLS);
+	CHECK(scheduler.isLoaded());
+
+	std::vector<std::thread> streams;
+	for (int s = 0; s < STREAMS; s++)
+		streams.push_back(std::thread(runStream, std::ref(scheduler), s, std::ref(wrongAnswers), std::ref(sentTiles)));
+	for (size_t s = 0; s < streams.size(); s++)
+		streams[s].join();
+
+	CHECK(wrongAnswers == 0);
+	CHECK(overlaps == 0);
+
+	BatchStats stats = scheduler.stats();
+	CHECK(stats.requests == STREAMS * ROUNDS);
+	CHECK(stats.tiles == sentTiles);
+	CHECK(stats.batches >= 1 && stats.batches <= stats.requests);
+
+	// A stream alone does not wait for the others, which have left
+	std::unique_ptr<DigitClassifier> client = scheduler.createClient();
+	std::vector<unsigned char> tiles(CELL_PIXELS, 0);
+	int digit;
+	client->predict(&tiles[0], NULL, 1, &digit);
+	CHECK(digit == 0);
+	CHECK(scheduler.stats().batches == stats.batches + 1);
+
+	testFailingClassifier();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,323 @@
+/**
+	test_digit_cnn.cpp
+	Purpose:	* Unit test of DigitCnn against a direct reference convolution, on
+				fixed tiles and fixed random weights: the float Winograd path must
+				give the probabilities of the float reference, the int8 path those
+				of the same reference run on the quantized weights.
+
+	@version 1.0
+*/
+
+#include "DigitCnn.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const int KERNEL = 3;
+	const int CONV1_SIZE = CELL_SIZE - 2;	// 26
+	const int CONV1_CHANNELS = 32;
+	const int CONV2_SIZE = CONV1_SIZE - 2;	// 24
+	const int CONV2_CHANNELS = 64;
+	const int POOL_SIZE = CONV2_SIZE / 2;	// 12
+	const int FEATURES = POOL_SIZE * POOL_SIZE * CONV2_CHANNELS;
+	const int HIDDEN = 128;
+
+	const int GROUP = 4;
+	const int MAX_ACTIVATION = 127;
+	const int MAX_WEIGHT = 127;
+
+	const int TILES = 8;
+
+	// Largest difference of the probability of the chosen digit
+	const float FLOAT_TOLERANCE = 1e-4f;
+	const float INT8_TOLERANCE = 1e-3f; // a requantization may round a tie the other way
+
+	// A tile with a black pixel where 'isInk' says so
+	template<class F>
+	void drawTile(unsigned char* tile, F isInk)
+	{
+		for (int y = 0; y < CELL_SIZE; y++)
+			for (int x = 0; x < CELL_SIZE; x++)
+				tile[y * CELL_SIZE + x] = isInk(y, x) ? 20 : 235;
+	}
+
+	// Blank, strokes of the shapes of digits and noise; the same every run
+	std::vector<unsigned char> fixedTiles()
+	{
+		std::vector<unsigned char> tiles((size_t)TILES * CELL_PIXELS);
+		unsigned char* t = &tiles[0];
+		drawTile(t, [](int y, int x) { return false; });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { return x >= 13 && x <= 15 && y >= 4 && y <= 23; });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { return (y >= 13 && y <= 15 && x >= 5 && x <= 22) || (x >= 13 && x <= 15 && y >= 5 && y <= 22); });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { int r = (y - 14) * (y - 14) + (x - 14) * (x - 14); return r >= 49 && r <= 81; });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { return abs(y - x) <= 1 && y >= 3 && y <= 24; });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { return (y >= 4 && y <= 6 && x >= 6 && x <= 21) || (abs(x - (27 - y)) <= 1 && y > 6 && y <= 23); });
+		drawTile(t += CELL_PIXELS, [](int y, int x) { return y <= 1 || x <= 1 || y >= 26 || x >= 26; });
+		std::mt19937 random(7);
+		for (int i = 0; i < CELL_PIXELS; i++)
+			t[CELL_PIXELS + i] = (unsigned char)(random() % 256);
+		return tiles;
+	}
+
+	// Random weights of the scale of a trained network, in the layouts of DigitCnnWeights
+	DigitCnnWeights randomWeights(std::vector<float>& parameters)
+	{
+		std::mt19937 random(1);
+		std::normal_distribution<float> normal(0.0f, 0.05f);
+		parameters.resize(DigitCnn::parameterCount());
+		for (size_t i = 0; i < parameters.size(); i++)
+			parameters[i] = normal(random);
+
+		DigitCnnWeights w;
+		const float* p = &parameters[0];
+		w.conv1Kernel = p;	p += KERNEL * KERNEL * CONV1_CHANNELS;
+		w.conv1Bias = p;	p += CONV1_CHANNELS;
+		w.conv2Kernel = p;	p += KERNEL * KERNEL * CONV1_CHANNELS * CONV2_CHANNELS;
+		w.conv2Bias = p;	p += CONV2_CHANNELS;
+		w.dense1Kernel = p;	p += (size_t)FEATURES * HIDDEN;
+		w.dense1Bias = p;	p += HIDDEN;
+		w.dense2Kernel = p;	p += HIDDEN * DIGIT_CLASSES;
+		w.dense2Bias = p;
+		return w;
+	}
+
+	// Valid 3 x 3 convolution of an HWC map with an HWIO kernel, straight from the definition, no ReLU
+	void convolve(const std::vector<float>& in, int size, int channels, const float* kernel, int outChannels, std::vector<float>& out)
+	{
+		int outSize = size - KERNEL + 1;
+		out.assign((size_t)outSize * outSize * outChannels, 0.0f);
+		for (int y = 0; y < outSize; y++)
+			for (int x = 0; x < outSize; x++)
+				for (int ky = 0; ky < KERNEL; ky++)
+					for (int kx = 0; kx < KERNEL; kx++)
+						for (int c = 0; c < channels; c++)
+						{
+							float v = in[((size_t)(y + ky) * size + x + kx) * channels + c];
+							const float* k = kernel + ((size_t)(ky * KERNEL + kx) * channels + c) * outChannels;
+							float* o = &out[((size_t)y * outSize + x) * outChannels];
+							for (int oc = 0; oc < outChannels; oc++)
+								o[oc] += v * k[oc];
+						}
+	}
+
+	void maxPool(const std::vector<float>& in, std::vector<float>& out)
+	{
+		out.resize(FEATURES);
+		for (int y = 0; y < POOL_SIZE; y++)
+			for (int x = 0; x < POOL_SIZE; x++)
+				for (int c = 0; c < CONV2_CHANNELS; c++)
+				{
+					const float* p = &in[((size_t)(2 * y) * CONV2_SIZE + 2 * x) * CONV2_CHANNELS + c];
+					out[((size_t)y * POOL_SIZE + x) * CONV2_CHANNELS + c] = std::max(std::max(p[0], p[CONV2_CHANNELS]),
+						std::max(p[CONV2_SIZE * CONV2_CHANNELS], p[(CONV2_SIZE + 1) * CONV2_CHANNELS]));
+				}
+	}
+
+	std::vector<float> binaryInput(const unsigned char* tile)
+	{
+		std::vector<float> input(CELL_PIXELS);
+		for (int i = 0; i < CELL_PIXELS; i++)
+			input[i] = tile[i] > INPUT_THRESHOLD ? 0.0f : 1.0f;
+		return input;
+	}
+
+	// ReLU, dense 2 and softmax of the dense 1 output
+	void softmax(const DigitCnnWeights& w, const float* hidden, float probabilities[DIGIT_CLASSES])
+	{
+		float logits[DIGIT_CLASSES], maxLogit = -1e30f, sum = 0;
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+		{
+			logits[c] = w.dense2Bias[c];
+			for (int h = 0; h < HIDDEN; h++)
+				logits[c] += std::max(0.0f, hidden[h]) * w.dense2Kernel[h * DIGIT_CLASSES + c];
+			maxLogit = std::max(maxLogit, logits[c]);
+		}
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			sum += probabilities[c] = expf(logits[c] - maxLogit);
+		for (int c = 0; c < DIGIT_CLASSES; c++)
+			probabilities[c] /= sum;
+	}
+
+	// The float network, layer by layer. Keeps the ReLU outputs of both convolutions for the calibration
+	void referencePredict(const DigitCnnWeights& w, const unsigned char* tile, float probabilities[DIGIT_CLASSES],
+		std::vector<float>& conv1, std::vector<float>& conv2)
+	{
+		std::vector<float> features;
+		convolve(binaryInput(tile), CELL_SIZE, 1, w.conv1Kernel, CONV1_CHANNELS, conv1);
+		for (size_t i = 0; i < conv1.size(); i++)
+			conv1[i] = std::max(0.0f, conv1[i] + w.conv1Bias[i % CONV1_CHANNELS]);
+		convolve(conv1, CONV1_SIZE, CONV1_CHANNELS, w.conv2Kernel, CONV2_CHANNELS, conv2);
+		for (size_t i = 0; i < conv2.size(); i++)
+			conv2[i] = std::max(0.0f, conv2[i] + w.conv2Bias[i % CONV2_CHANNELS]);
+		maxPool(conv2, features);
+
+		float hidden[HIDDEN];
+		for (int h = 0; h < HIDDEN; h++)
+		{
+			hidden[h] = w.dense1Bias[h];
+			for (int f = 0; f < FEATURES; f++)
+				hidden[h] += features[f] * w.dense1Kernel[(size_t)f * HIDDEN + h];
+		}
+		softmax(w, hidden, probabilities);
+	}
+
+	float toActivation(float value)
+	{
+		return floorf(std::min((float)MAX_ACTIVATION, std::max(0.0f, value)) + 0.5f);
+	}
+
+	// scripts/quantize_cnn.py: int8 weights scaled per output channel, packed as inputs / 4 x outputs x 4
+	void quantizeKernel(const float* kernel, int inputs, int outputs, std::vector<signed char>& packed,
+		std::vector<float>& unpacked, std::vector<float>& scales)
+	{
+		packed.resize((size_t)inputs * outputs);
+		unpacked.resize((size_t)inputs * outputs);
+		scales.assign(outputs, 1e-12f);
+		for (int i = 0; i < inputs; i++)
+			for (int o = 0; o < outputs; o++)
+				scales[o] = std::max(scales[o], fabsf(kernel[(size_t)i * outputs + o]));
+		for (int o = 0; o < outputs; o++)
+			scales[o] /= MAX_WEIGHT;
+
+		for (int i = 0; i < inputs; i++)
+			for (int o = 0; o < outputs; o++)
+			{
+				float q = std::min((float)MAX_WEIGHT, std::max(-(float)MAX_WEIGHT, roundf(kernel[(size_t)i * outputs + o] / scales[o])));
+				packed[((size_t)(i / GROUP) * outputs + o) * GROUP + i % GROUP] = (signed char)q;
+				unpacked[(size_t)i * outputs + o] = q;
+			}
+	}
+
+	// The quantized network of DigitCnnQuantizedWeights, with the integer weights kept as floats
+	typedef struct
+	{
+		DigitCnnQuantizedWeights weights;
+		std::vector<signed char> conv2Kernel, dense1Kernel;
+		std::vector<float> conv2Unpacked, dense1Unpacked;
+		std::vector<float> conv2Multiplier, conv2Offset, dense1Multiplier;
+	} QuantizedNetwork;
+
+	// Calibrated on the largest activations of the tiles
+	void quantize(const DigitCnnWeights& w, float conv1Max, float conv2Max, QuantizedNetwork& q)
+	{
+		float conv1Scale = conv1Max / MAX_ACTIVATION, conv2Scale = conv2Max / MAX_ACTIVATION;
+		std::vector<float> scales;
+
+		quantizeKernel(w.conv2Kernel, KERNEL * KERNEL * CONV1_CHANNELS, CONV2_CHANNELS, q.conv2Kernel, q.conv2Unpacked, scales);
+		q.conv2Multiplier.resize(CONV2_CHANNELS);
+		q.conv2Offset.resize(CONV2_CHANNELS);
+		for (int o = 0; o < CONV2_CHANNELS; o++)
+		{
+			q.conv2Multiplier[o] = conv1Scale * scales[o] / conv2Scale;
+			q.conv2Offset[o] = w.conv2Bias[o] / conv2Scale;
+		}
+
+		quantizeKernel(w.dense1Kernel, FEATURES, HIDDEN, q.dense1Kernel, q.dense1Unpacked, scales);
+		q.dense1Multiplier.resize(HIDDEN);
+		for (int h = 0; h < HIDDEN; h++)
+			q.dense1Multiplier[h] = conv2Scale * scales[h];
+
+		q.weights.conv1Scale = conv1Scale;
+		q.weights.conv2Kernel = &q.conv2Kernel[0];
+		q.weights.conv2Multiplier = &q.conv2Multiplier[0];
+		q.weights.conv2Offset = &q.conv2Offset[0];
+		q.weights.dense1Kernel = &q.dense1Kernel[0];
+		q.weights.dense1Multiplier = &q.dense1Multiplier[0];
+	}
+
+	// quantized_forward of scripts/quantize_cnn.py: the same reference convolution on 7-bit activations
+	void quantizedReferencePredict(const DigitCnnWeights& w, const QuantizedNetwork& q, const unsigned char* tile,
+		float probabilities[DIGIT_CLASSES])
+	{
+		std::vector<float> conv1, conv2, features;
+		convolve(binaryInput(tile), CELL_SIZE, 1, w.conv1Kernel, CONV1_CHANNELS, conv1);
+		for (size_t i = 0; i < conv1.size(); i++)
+			conv1[i] = toActivation((conv1[i] + w.conv1Bias[i % CONV1_CHANNELS]) / q.weights.conv1Scale);
+		convolve(conv1, CONV1_SIZE, CONV1_CHANNELS, &q.conv2Unpacked[0], CONV2_CHANNELS, conv2);
+		for (size_t i = 0; i < conv2.size(); i++)
+			conv2[i] = toActivation(conv2[i] * q.conv2Multiplier[i % CONV2_CHANNELS] + q.conv2Offset[i % CONV2_CHANNELS]);
+		maxPool(conv2, features);
+
+		float hidden[HIDDEN];
+		for (int h = 0; h < HIDDEN; h++)
+		{
+			double acc = 0;
+			for (int f = 0; f < FEATURES; f++)
+				acc += features[f] * q.dense1Unpacked[(size_t)f * HIDDEN + h];
+			hidden[h] = (float)acc * q.dense1Multiplier[h] + w.dense1Bias[h];
+		}
+		softmax(w, hidden, probabilities);
+	}
+
+	// DigitCnn gives the digit of the largest reference probability, and that probability
+	void checkAgainst(const std::vector<float>& expected, const int* digits, const float* confidences, float tolerance)
+	{
+		for (int t = 0; t < TILES; t++)
+		{
+			const float* p = &expected[(size_t)t * DIGIT_CLASSES];
+			int digit = (int)(std::max_element(p, p + DIGIT_CLASSES) - p);
+
+			// The runner-up within the tolerance could be picked as well
+			float runnerUp = 0;
+			for (int c = 0; c < DIGIT_CLASSES; c++)
+				if (c != digit)
+					runnerUp = std::max(runnerUp, p[c]);
+			CHECK(digits[t] == digit || p[digit] - runnerUp < tolerance);
+			CHECK(digits[t] >= 0 && digits[t] < DIGIT_CLASSES);
+			CHECK(fabsf(p[digits[t]] - confidences[t]) < tolerance);
+		}
+	}
+}
+
+int main()
+{
+	std::vector<float> parameters;
+	DigitCnnWeights weights = randomWeights(parameters);
+	std::vector<unsigned char> tiles = fixedTiles();
+
+	std::vector<float> expected((size_t)TILES * DIGIT_CLASSES), conv1, conv2;
+	float conv1Max = 0, conv2Max = 0;
+	for (int t = 0; t < TILES; t++)
+	{
+		referencePredict(weights, &tiles[(size_t)t * CELL_PIXELS], &expected[(size_t)t * DIGIT_CLASSES], conv1, conv2);
+		conv1Max = std::max(conv1Max, *std::max_element(conv1.begin(), conv1.end()));
+		conv2Max = std::max(conv2Max, *std::max_element(conv2.begin(), conv2.end()));
+	}
+
+	int digits[TILES];
+	float confidences[TILES];
+
+	// Float: Winograd F(2 x 2, 3 x 3), fused with the ReLUs and the pooling
+	DigitCnn cnn;
+	cnn.setWeights(weights);
+	CHECK(cnn.isLoaded() && !cnn.isQuantized());
+	cnn.predict(&tiles[0], NULL, TILES, digits, confidences);
+	checkAgainst(expected, digits, confidences, FLOAT_TOLERANCE);
+
+	// Skipped tiles are not classified, the others keep their answers
+	bool skip[TILES] = { true, false, true, false, false, true, false, false };
+	int skippedDigits[TILES];
+	float skippedConfidences[TILES];
+	cnn.predict(&tiles[0], skip, TILES, skippedDigits, skippedConfidences);
+	for (int t = 0; t < TILES; t++)
+		CHECK(skip[t] ? skippedDigits[t] == -1 : skippedDigits[t] == digits[t] && fabsf(skippedConfidences[t] - confidences[t]) < FLOAT_TOLERANCE);
+
+	// Int8: against the reference on the same quantized weights
+	QuantizedNetwork quantized;
+	quantize(weights, conv1Max, conv2Max, quantized);
+	for (int t = 0; t < TILES; t++)
+		quantizedReferencePredict(weights, quantized, &tiles[(size_t)t * CELL_PIXELS], &expected[(size_t)t * DIGIT_CLASSES]);
+
+	DigitCnn quantizedCnn;
+	quantizedCnn.setQuantizedWeights(weights, quantized.weights);
+	CHECK(quantizedCnn.isLoaded() && quantizedCnn.isQuantized());
+	quantizedCnn.predict(&tiles[0], NULL, TILES, digits, confidences);
+	checkAgainst(expected, digits, confidences, INT8_TOLERANCE);
+
+	return TEST_RESULT();
+}
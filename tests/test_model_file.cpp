@@ -0,0 +1,183 @@
+/**
+	test_model_file.cpp
+	Purpose:	* Unit test of the ModelFile checks: a valid file maps and hands out
+				its tensors, a bad magic, a truncated file, misaligned or out of
+				range offsets and broken names are refused.
+
+	@version 1.0
+*/
+
+#include "ModelFile.h"
+#include "TestCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const char* PATH = "test_model_file.model";
+
+	const float WEIGHTS[6] = { 0.5f, -1.0f, 2.0f, 0.25f, -0.125f, 3.0f };
+	const signed char QUANTIZED[5] = { -127, -1, 0, 1, 127 };
+
+	size_t alignUp(size_t bytes)
+	{
+		return (bytes + MODEL_FILE_ALIGN - 1) / MODEL_FILE_ALIGN * MODEL_FILE_ALIGN;
+	}
+
+	void addEntry(std::vector<unsigned char>& file, std::vector<ModelTensorEntry>& entries, const char* name,
+		ModelDataType type, const void* data, uint32_t count, size_t elementSize)
+	{
+		ModelTensorEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		strncpy(entry.name, name, MODEL_TENSOR_NAME_SIZE - 1);
+		entry.type = type;
+		entry.rank = 1;
+		entry.shape[0] = count;
+		entry.shape[1] = entry.shape[2] = entry.shape[3] = 1;
+		entry.offset = file.size();
+		entry.bytes = count * elementSize;
+		entries.push_back(entry);
+
+		file.resize(alignUp(file.size() + entry.bytes));
+		memcpy(&file[entry.offset], data, entry.bytes);
+	}
+
+	// What scripts/export_cnn.py writes: header, table of tensors, data, every part 64-byte aligned
+	std::vector<unsigned char> buildModel()
+	{
+		const int TENSORS = 2;
+		std::vector<unsigned char> file(alignUp(sizeof(ModelFileHeader) + TENSORS * sizeof(ModelTensorEntry)));
+		std::vector<ModelTensorEntry> entries;
+		addEntry(file, entries, "dense.kernel", MODEL_FLOAT32, WEIGHTS, 6, sizeof(float));
+		addEntry(file, entries, "dense.qkernel", MODEL_INT8, QUANTIZED, 5, sizeof(signed char));
+
+		ModelFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+		header.version = MODEL_FILE_VERSION;
+		header.tensorCount = TENSORS;
+		header.fileSize = file.size();
+		memcpy(&file[0], &header, sizeof(header));
+		memcpy(&file[sizeof(header)], &entries[0], TENSORS * sizeof(ModelTensorEntry));
+		return file;
+	}
+
+	ModelFileHeader* header(std::vector<unsigned char>& file)
+	{
+		return (ModelFileHeader*)&file[0];
+	}
+
+	ModelTensorEntry* entry(std::vector<unsigned char>& file, int i)
+	{
+		return (ModelTensorEntry*)&file[sizeof(ModelFileHeader)] + i;
+	}
+
+	bool writeAndOpen(const std::vector<unsigned char>& file, ModelFile& model)
+	{
+		FILE* out = fopen(PATH, "wb");
+		if (!out)
+			return false;
+		fwrite(file.data(), 1, file.size(), out);
+		fclose(out);
+		return model.open(PATH);
+	}
+
+	void testValidFile()
+	{
+		std::vector<unsigned char> file = buildModel();
+		ModelFile model;
+		CHECK(writeAndOpen(file, model));
+		CHECK(model.isOpen());
+
+		const float* weights = model.floats("dense.kernel", 6);
+		CHECK(weights != NULL);
+		CHECK(weights && memcmp(weights, WEIGHTS, sizeof(WEIGHTS)) == 0);
+		CHECK((size_t)weights % MODEL_FILE_ALIGN == 0); // the mapping is page aligned
+
+		const signed char* quantized = model.int8s("dense.qkernel", 5);
+		CHECK(quantized && memcmp(quantized, QUANTIZED, sizeof(QUANTIZED)) == 0);
+
+		// Wrong size, wrong type, unknown name
+		CHECK(model.floats("dense.kernel", 5) == NULL);
+		CHECK(model.int8s("dense.kernel", 24) == NULL);
+		CHECK(model.floats("conv1.kernel", 6) == NULL);
+		CHECK(model.hasTensor("dense.qkernel"));
+		CHECK(!model.hasTensor("dense"));
+
+		model.close();
+		CHECK(!model.isOpen());
+		CHECK(model.floats("dense.kernel", 6) == NULL);
+	}
+
+	void testHeader()
+	{
+		ModelFile model;
+		std::vector<unsigned char> file = buildModel();
+		header(file)->magic[0] = 'X';
+		CHECK(!writeAndOpen(file, model));
+		CHECK(!model.isOpen());
+
+		file = buildModel();
+		header(file)->version = MODEL_FILE_VERSION + 1;
+		CHECK(!writeAndOpen(file, model));
+
+		// Shorter than a header
+		file.assign(sizeof(ModelFileHeader) / 2, 0);
+		CHECK(!writeAndOpen(file, model));
+
+		// Empty file: nothing to map
+		file.clear();
+		CHECK(!writeAndOpen(file, model));
+	}
+
+	void testTruncated()
+	{
+		ModelFile model;
+		std::vector<unsigned char> file = buildModel();
+		file.resize(file.size() - MODEL_FILE_ALIGN);
+		CHECK(!writeAndOpen(file, model));
+
+		// A table of tensors longer than the file
+		file = buildModel();
+		header(file)->tensorCount = 1000;
+		CHECK(!writeAndOpen(file, model));
+	}
+
+	void testEntries()
+	{
+		ModelFile model;
+		std::vector<unsigned char> file = buildModel();
+		entry(file, 1)->offset += 4;
+		CHECK(!writeAndOpen(file, model));
+
+		// Data past the end of the file
+		file = buildModel();
+		entry(file, 0)->bytes = file.size();
+		CHECK(!writeAndOpen(file, model));
+
+		file = buildModel();
+		entry(file, 0)->offset = alignUp(file.size() + 1);
+		CHECK(!writeAndOpen(file, model));
+
+		// A name without its 0
+		file = buildModel();
+		memset(entry(file, 0)->name, 'a', MODEL_TENSOR_NAME_SIZE);
+		CHECK(!writeAndOpen(file, model));
+
+		// Reopening a valid file after all that
+		CHECK(writeAndOpen(buildModel(), model));
+	}
+}
+
+int main()
+{
+	testValidFile();
+	testHeader();
+	testTruncated();
+	testEntries();
+	remove(PATH);
+	return TEST_RESULT();
+}
@@ -0,0 +1,156 @@
+/**
+	test_recognition_cache.cpp
+	Purpose:	* Unit test of the RecognitionCache: the distance of the tile hashes,
+				the majority of the votes of a cell and when it gets settled.
+
+	@version 1.0
+*/
+
+#include "RecognitionCache.h"
+#include "CellExtractor.h"
+#include "TestCheck.h"
+
+#include <vector>
+
+namespace
+{
+	// Same settings as SudokuAR
+	const int HISTORY = 5;
+	const int SAME_DISTANCE = 3;
+	const int NEW_CONTENT_DISTANCE = 12;
+
+	// Cell 0 holds a digit, cell 1 is blank
+	const int CELLS = 2;
+	const bool BLANK[CELLS] = { false, true };
+
+	int hashDistance(uint64_t a, uint64_t b)
+	{
+		int bits = 0;
+		for (uint64_t x = a ^ b; x; x &= x - 1)
+			bits++;
+		return bits;
+	}
+
+	// White tile with a black bar across it, vertical or horizontal, through the middle
+	void drawBar(unsigned char* tile, bool isVertical)
+	{
+		for (int i = 0; i < CELL_PIXELS; i++)
+			tile[i] = 255;
+		for (int a = 0; a < CELL_SIZE; a++)
+		{
+			for (int b = 12; b < 16; b++)
+				tile[isVertical ? a * CELL_SIZE + b : b * CELL_SIZE + a] = 0;
+		}
+	}
+
+	// Classifies cell 0 as 'digit' if the cache asks for it
+	bool classify(RecognitionCache& cache, const std::vector<unsigned char>& tiles, int digit, bool* isChanged)
+	{
+		bool toClassify[CELLS];
+		cache.lookup(&tiles[0], BLANK, toClassify);
+		int digits[CELLS] = { toClassify[0] ? digit : -1, -1 };
+		*isChanged = cache.vote(BLANK, toClassify, digits);
+		return toClassify[0];
+	}
+
+	int votedDigit(const RecognitionCache& cache, int cell)
+	{
+		int digits[CELLS];
+		cache.votedDigits(BLANK, digits);
+		return digits[cell];
+	}
+
+	void testHashDistance()
+	{
+		std::vector<unsigned char> vertical(CELL_PIXELS), noisy, horizontal(CELL_PIXELS);
+		drawBar(&vertical[0], true);
+		drawBar(&horizontal[0], false);
+
+		// A few pixels of noise in the background keep the hash
+		noisy = vertical;
+		noisy[1 * CELL_SIZE + 1] = 180;
+		noisy[26 * CELL_SIZE + 25] = 200;
+		uint64_t hash = RecognitionCache::hashTile(&vertical[0]);
+		CHECK(hash != 0);
+		CHECK(RecognitionCache::hashTile(&vertical[0]) == hash);
+		CHECK(hashDistance(RecognitionCache::hashTile(&noisy[0]), hash) <= SAME_DISTANCE);
+
+		// Another stroke is new content
+		CHECK(hashDistance(RecognitionCache::hashTile(&horizontal[0]), hash) >= NEW_CONTENT_DISTANCE);
+	}
+
+	void testMajorityAndSettling()
+	{
+		RecognitionCache cache(CELLS, HISTORY, SAME_DISTANCE, NEW_CONTENT_DISTANCE);
+		std::vector<unsigned char> tiles((size_t)CELLS * CELL_PIXELS, 255);
+		drawBar(&tiles[0], true);
+
+		bool isChanged;
+		int digits[CELLS];
+		CHECK(!cache.votedDigits(BLANK, digits));
+		CHECK(digits[1] == 0);
+
+		// 7, then a misread 1: no majority
+		CHECK(classify(cache, tiles, 7, &isChanged));
+		CHECK(isChanged);
+		CHECK(votedDigit(cache, 0) == -1); // 1 of 5 votes could still be overturned
+		CHECK(classify(cache, tiles, 1, &isChanged));
+		CHECK(votedDigit(cache, 0) == -1);
+
+		// 7, 1, 7: majority but not settled, the 2 missing votes could make it 1
+		CHECK(classify(cache, tiles, 7, &isChanged));
+		CHECK(votedDigit(cache, 0) == -1);
+
+		// 7, 1, 7, 7: 3 votes against 1 + 1 missing, settled
+		CHECK(classify(cache, tiles, 7, &isChanged));
+		CHECK(isChanged);
+		CHECK(cache.votedDigits(BLANK, digits));
+		CHECK(digits[0] == 7);
+		CHECK(digits[1] == 0);
+
+		// Settled and the same tile: not classified again, a little noise neither
+		CHECK(!classify(cache, tiles, 1, &isChanged));
+		CHECK(!isChanged);
+		tiles[2 * CELL_SIZE + 2] = 190;
+		CHECK(!classify(cache, tiles, 1, &isChanged));
+		CHECK(votedDigit(cache, 0) == 7);
+
+		// Something else written in the cell: the old votes are dropped, the new digit needs its own majority
+		drawBar(&tiles[0], false);
+		CHECK(classify(cache, tiles, 4, &isChanged));
+		CHECK(isChanged);
+		CHECK(votedDigit(cache, 0) == -1);
+		for (int i = 0; i < 2; i++)
+			CHECK(classify(cache, tiles, 4, &isChanged));
+		CHECK(votedDigit(cache, 0) == 4); // 3 of 5, nothing else to catch up
+
+		// A new grid forgets everything
+		cache.clear();
+		CHECK(votedDigit(cache, 0) == -1);
+		CHECK(classify(cache, tiles, 4, &isChanged));
+	}
+
+	void testOutOfRangeVotes()
+	{
+		RecognitionCache cache(CELLS, HISTORY, SAME_DISTANCE, NEW_CONTENT_DISTANCE);
+		std::vector<unsigned char> tiles((size_t)CELLS * CELL_PIXELS, 255);
+		drawBar(&tiles[0], true);
+
+		// Answers outside 0 ... 9 are no votes
+		bool isChanged;
+		for (int i = 0; i < HISTORY; i++)
+		{
+			classify(cache, tiles, 10, &isChanged);
+			CHECK(!isChanged);
+		}
+		CHECK(votedDigit(cache, 0) == -1);
+	}
+}
+
+int main()
+{
+	testHashDistance();
+	testMajorityAndSettling();
+	testOutOfRangeVotes();
+	return TEST_RESULT();
+}